@@ -0,0 +1,139 @@
+#include "geometry.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+// Usage: ./geometry_benchmark <input_file> [proofs] [geometry...]
+// Build from the repository root:
+//   g++ -O2 -I. analysis/geometry_benchmark.cpp geometry.cpp -lcrypto -lpthread -o geometry_benchmark
+// Sweeps every supported geometry (or the given ones, e.g. 2x64 4x1024) and
+// writes the results to geometry.csv.
+
+struct Result {
+    por::Geometry geometry;
+    int plots = 0;
+    double plot_mb_s = 0;
+    uint64_t disk_bytes = 0;
+    size_t proof_bytes = 0;
+    double prove_p50_us = 0;
+    double prove_p99_us = 0;
+    double verify_per_s = 0;
+};
+
+static uint64_t directory_size(const std::string& dir) {
+    uint64_t bytes = 0;
+    for (const auto& entry : fs::recursive_directory_iterator(dir)) {
+        if (entry.is_regular_file())
+            bytes += entry.file_size();
+    }
+    return bytes;
+}
+
+static Result run(const por::Geometry& geometry, const std::string& input, size_t proofs) {
+    Result r;
+    r.geometry = geometry;
+
+    por::PlotConfig config;
+    config.plot_dir = "bench/" + std::to_string(geometry.fanout) + "x" + std::to_string(geometry.leaves);
+    fs::remove_all(config.plot_dir);
+    fs::create_directories(config.plot_dir);
+    auto p = por::make_porep(geometry, config);
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    p->plot(input);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    r.plots = p->get_plots();
+    r.plot_mb_s = (double)(p->get_plots() + p->get_conflicts()) * p->chunk_size() / 1e6 /
+                  std::chrono::duration<double>(end - begin).count();
+    r.disk_bytes = directory_size(config.plot_dir);
+    r.proof_bytes = p->proof_hashes() * sizeof(por::DynamicPoRep::Hash);
+
+    std::mt19937_64 rng(42);
+    std::vector<por::DynamicPoRep::Hash> challenges(proofs);
+    for (auto& c : challenges)
+        for (auto& b : c.bytes)
+            b = rng();
+
+    std::vector<por::DynamicProof> generated;
+    std::vector<double> latencies;
+    generated.reserve(proofs);
+    latencies.reserve(proofs);
+    for (const auto& c : challenges) {
+        std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+        generated.push_back(p->generate_proof(c));
+        std::chrono::steady_clock::time_point received = std::chrono::steady_clock::now();
+        latencies.push_back(std::chrono::duration<double, std::micro>(received - sent).count());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    r.prove_p50_us = latencies[latencies.size() / 2];
+    r.prove_p99_us = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+
+    size_t valid = 0;
+    begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < proofs; i++)
+        valid += p->verify(generated[i], challenges[i]);
+    end = std::chrono::steady_clock::now();
+    if (valid != proofs)
+        throw std::runtime_error(geometry.to_string() + ": " + std::to_string(proofs - valid) + " proofs failed to verify");
+    r.verify_per_s = proofs / std::chrono::duration<double>(end - begin).count();
+
+    fs::remove_all(config.plot_dir);
+    return r;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cout << "Usage: " << argv[0] << " <input_file> [proofs] [geometry...]\n";
+        return 1;
+    }
+    std::string input = argv[1];
+    size_t proofs = argc > 2 ? std::stoul(argv[2]) : 1000;
+    uint64_t input_size = fs::file_size(input);
+
+    std::vector<por::Geometry> geometries;
+    for (int i = 3; i < argc; i++)
+        geometries.push_back(por::Geometry::parse(argv[i]));
+    if (geometries.empty())
+        geometries = por::geometries();
+
+    std::vector<Result> results;
+    for (const auto& g : geometries) {
+        if (g.leaves * sizeof(por::DynamicPoRep::Hash) > input_size) {
+            std::cout << "Skipping " << g.to_string() << ": input smaller than one chunk" << std::endl;
+            continue;
+        }
+        std::cout << "Running " << g.to_string() << "..." << std::endl;
+        results.push_back(run(g, input, proofs));
+    }
+    fs::remove_all("bench");
+
+    std::ofstream csv("geometry.csv");
+    csv << "geometry,plots,plot_mb_s,disk_bytes,disk_per_input,proof_bytes,prove_p50_us,prove_p99_us,verify_per_s" << std::endl;
+    std::cout << std::endl << std::left
+              << std::setw(18) << "geometry" << std::right
+              << std::setw(8) << "plots"
+              << std::setw(12) << "plot MB/s"
+              << std::setw(14) << "disk bytes"
+              << std::setw(10) << "x input"
+              << std::setw(12) << "proof B"
+              << std::setw(12) << "p50 [us]"
+              << std::setw(12) << "p99 [us]"
+              << std::setw(14) << "verify/s" << std::endl;
+    for (const Result& r : results) {
+        double amplification = (double)r.disk_bytes / (r.plots * r.geometry.leaves * sizeof(por::DynamicPoRep::Hash));
+        csv << r.geometry.to_string() << "," << r.plots << "," << r.plot_mb_s << "," << r.disk_bytes << ","
+            << amplification << "," << r.proof_bytes << "," << r.prove_p50_us << "," << r.prove_p99_us << ","
+            << r.verify_per_s << std::endl;
+        std::cout << std::left << std::setw(18) << r.geometry.to_string() << std::right << std::fixed
+                  << std::setw(8) << r.plots
+                  << std::setw(12) << std::setprecision(2) << r.plot_mb_s
+                  << std::setw(14) << r.disk_bytes
+                  << std::setw(10) << std::setprecision(2) << amplification
+                  << std::setw(12) << r.proof_bytes
+                  << std::setw(12) << std::setprecision(1) << r.prove_p50_us
+                  << std::setw(12) << std::setprecision(1) << r.prove_p99_us
+                  << std::setw(14) << std::setprecision(0) << r.verify_per_s << std::endl;
+    }
+    csv.close();
+}
@@ -1,31 +1,191 @@
 #include "por.hpp"
 
-#include <filesystem>
+#include <cstdio>
+#include <iostream>
+#include <string_view>
 
+// Usage: ./hash_distribution [plot_dir] [bits] [first_bit] [threads]
+// Build from the repository root:
+//   g++ -O2 -I. analysis/hash_distribution.cpp -lcrypto -lpthread -o hash_distribution
+//
+// Streams the roots of a plot store without indexing them. The threads take
+// batches of directory entries in turn, decode the roots plot files are
+// named after and read segment .roots lists line by line, skipping dead
+// records. Every thread buckets the roots into its own histogram by bits
+// [first_bit, first_bit + bits) of the root, counted from the most
+// significant bit, and the histograms are added up at the end. That is the
+// part of a root that decides which challenges it is closest to. Writes
+// dist.csv (see plot.py) and prints the chi-square statistic against a
+// uniform distribution.
+//
+// A plot that an interrupted compact() left both in its own file and in a
+// segment is counted twice until the next compact() deletes the file.
 
-int bucket_id(merkle::HashT<32> h, int num_buckets) {
-    return h % num_buckets;
-}
+typedef por::PoRep PoRep;
+typedef PoRep::Hash Hash;
+
+/// @brief Most bits bucketed at once, 128 MiB of counters per thread
+static constexpr size_t MAX_BITS = 24;
+
+/// @brief Directory entries a thread takes at once
+static constexpr size_t ENTRIES = 4096;
+
+/// @brief Length of a hex root
+static constexpr size_t ROOT_CHARS = 2 * sizeof(Hash);
 
+/// @brief Root counts per bucket of one thread
+struct Histogram {
+    size_t bits;
+    size_t first_bit;
+    std::vector<uint64_t> counts;
+    uint64_t roots = 0;
+    uint64_t dead = 0;
+    uint64_t invalid = 0;
 
-int main() {
-    por::PoRepT<32, merkle::sha256, 2, 64>  p;
-    int buckets = 1000;
-    uint64_t dis[buckets];
+    Histogram(size_t bits, size_t first_bit) : bits(bits), first_bit(first_bit), counts(size_t(1) << bits, 0) {}
+
+    /// @brief Counts the root whose hex digits start at @p hex
+    void add(const char* hex) {
+        uint8_t prefix[8];
+        if (!merkle::hex_decode(hex, sizeof(prefix), prefix)) {
+            invalid++;
+            return;
+        }
+        uint64_t top = 0;
+        for (uint8_t b : prefix)
+            top = top << 8 | b;
+        counts[(top << first_bit) >> (64 - bits)]++;
+        roots++;
+    }
+
+    /// @brief Counts a line of a .roots file, a root or a dead record
+    void add_line(const char* line, size_t size) {
+        if (size == ROOT_CHARS)
+            add(line);
+        else if (std::string_view(line, size) == PoRep::DEAD_RECORD)
+            dead++;
+        else if (size > 0)
+            invalid++;
+    }
 
-    for (int i = 0; i < buckets; i++) {
-        dis[i] = 0;
+    /// @brief Counts the records of the .roots file at @p path, read through @p buffer
+    void add_roots_file(const std::string& path, std::vector<char>& buffer) {
+        FILE* f = fopen(path.c_str(), "rb");
+        if (f == nullptr)
+            return;
+        // Lines split by a read are kept at the front of the buffer
+        size_t kept = 0, n;
+        while ((n = fread(buffer.data() + kept, 1, buffer.size() - kept, f)) > 0) {
+            const char* text = buffer.data();
+            const char* end = text + kept + n;
+            const char* eol;
+            while ((eol = static_cast<const char*>(memchr(text, '\n', end - text))) != nullptr) {
+                add_line(text, eol - text);
+                text = eol + 1;
+            }
+            kept = end - text;
+            if (kept == buffer.size()) {
+                invalid++;
+                kept = 0;
+            }
+            memmove(buffer.data(), text, kept);
+        }
+        add_line(buffer.data(), kept);
+        fclose(f);
     }
 
-    for (auto itr = p.search.begin(); itr != p.search.end(); itr++) {
-        dis[bucket_id(*itr, buckets)] += 1;
+    void merge(const Histogram& other) {
+        for (size_t i = 0; i < counts.size(); i++)
+            counts[i] += other.counts[i];
+        roots += other.roots;
+        dead += other.dead;
+        invalid += other.invalid;
     }
+};
 
-    std::ofstream outfile ("dist.csv");
+/// @brief Entries of the store directory, handed out in batches
+class Scan {
+    public:
+        explicit Scan(const std::string& dir) : it(dir) {}
 
-    for (int i = 0; i < buckets; i++) {
-        outfile << i << "," << dis[i] << std::endl;
+        /// @return false once every entry has been handed out
+        bool next(std::vector<fs::path>& batch) {
+            batch.clear();
+            std::lock_guard<std::mutex> lock(m);
+            for (; it != fs::directory_iterator() && batch.size() < ENTRIES; ++it)
+                batch.push_back(it->path());
+            return !batch.empty();
+        }
+
+    private:
+        std::mutex m;
+        fs::directory_iterator it;
+};
+
+/// @brief Upper tail of the chi-square distribution, Wilson-Hilferty approximation
+static double chi_square_p_value(double statistic, double df) {
+    double z = (std::cbrt(statistic / df) - (1 - 2 / (9 * df))) / std::sqrt(2 / (9 * df));
+    return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+int main(int argc, char** argv) {
+    std::string plot_dir = argc > 1 ? argv[1] : "plot";
+    size_t bits = argc > 2 ? std::stoul(argv[2]) : 10;
+    size_t first_bit = argc > 3 ? std::stoul(argv[3]) : 0;
+    size_t threads = argc > 4 ? std::stoul(argv[4]) : std::max(1u, std::thread::hardware_concurrency());
+    if (bits == 0 || bits > MAX_BITS || first_bit + bits > 64)
+        throw std::runtime_error("Buckets take 1 to " + std::to_string(MAX_BITS) + " of the top 64 bits of a root");
+    if (threads == 0)
+        throw std::runtime_error("Bucketing needs at least one thread");
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    Scan scan(plot_dir);
+    std::vector<Histogram> histograms(threads, Histogram(bits, first_bit));
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            Histogram& h = histograms[t];
+            std::vector<fs::path> batch;
+            std::vector<char> buffer(1 << 20);
+            while (scan.next(batch)) {
+                for (const fs::path& path : batch) {
+                    // Plot files are named after their root, segments list theirs
+                    std::string name = path.filename();
+                    if (name.size() == ROOT_CHARS)
+                        h.add(name.data());
+                    else if (name.size() > 6 && name.compare(name.size() - 6, 6, ".roots") == 0)
+                        h.add_roots_file(path.string(), buffer);
+                }
+            }
+        });
     }
+    for (auto& w : workers)
+        w.join();
+    for (size_t t = 1; t < threads; t++)
+        histograms[0].merge(histograms[t]);
+    const Histogram& h = histograms[0];
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
 
+    std::ofstream outfile("dist.csv");
+    double expected = (double)h.roots / h.counts.size();
+    double statistic = 0;
+    uint64_t lowest = UINT64_MAX, highest = 0, empty = 0;
+    for (size_t i = 0; i < h.counts.size(); i++) {
+        outfile << i << "," << h.counts[i] << "\n";
+        double d = h.counts[i] - expected;
+        statistic += expected > 0 ? d * d / expected : 0;
+        lowest = std::min(lowest, h.counts[i]);
+        highest = std::max(highest, h.counts[i]);
+        empty += h.counts[i] == 0;
+    }
     outfile.close();
-}
\ No newline at end of file
+
+    double seconds = std::chrono::duration<double>(end - begin).count();
+    double df = h.counts.size() - 1;
+    std::cout << "Roots: " << h.roots << " (" << h.dead << " dead records, " << h.invalid << " invalid entries skipped)" << std::endl;
+    std::cout << "Buckets: " << h.counts.size() << " over bits [" << first_bit << ", " << first_bit + bits << ")" << std::endl;
+    std::cout << "Expected per bucket = " << expected << ", min = " << lowest << ", max = " << highest << ", empty = " << empty << std::endl;
+    std::cout << "Chi-square = " << statistic << " (df " << df << ", p = " << chi_square_p_value(statistic, df) << ")" << std::endl;
+    std::cout << "Scan time = " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << "[ms] ("
+              << h.roots / seconds << " roots/s)" << std::endl;
+}
@@ -0,0 +1,97 @@
+#include "por.hpp"
+
+#include <malloc.h>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+// Usage: ./index_benchmark <sidecar_dir> [roots] [lookups]
+// Build from the repository root:
+//   g++ -O2 -I. analysis/index_benchmark.cpp -lcrypto -lpthread -o index_benchmark
+//
+// Indexes <roots> random roots (2M by default) in a normal and in a compact
+// root index, see PlotConfig::compact_index, and reports for each the
+// anonymous and file-backed memory the snapshot keeps resident and the mean
+// latency of closest() over <lookups> random challenges.
+
+typedef por::PoRep PoRep;
+typedef PoRep::RootIndex RootIndex;
+
+/// @brief RssAnon and RssFile of /proc/self/status in bytes
+static std::pair<int64_t, int64_t> resident() {
+    std::ifstream f("/proc/self/status");
+    std::string line;
+    int64_t anon = 0, file = 0;
+    while (std::getline(f, line)) {
+        if (line.rfind("RssAnon:", 0) == 0)
+            anon = std::stoll(line.substr(8)) * 1024;
+        else if (line.rfind("RssFile:", 0) == 0)
+            file = std::stoll(line.substr(8)) * 1024;
+    }
+    return {anon, file};
+}
+
+static std::vector<PoRep::Hash> random_hashes(size_t count, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::vector<PoRep::Hash> hashes(count);
+    for (auto& h : hashes) {
+        for (auto& b : h.bytes)
+            b = rng();
+    }
+    return hashes;
+}
+
+static void run(const char* mode, const std::string& sidecar_dir,
+                const std::vector<PoRep::Hash>& roots, const std::vector<PoRep::Hash>& challenges) {
+    malloc_trim(0);
+    auto before = resident();
+
+    RootIndex index(roots.size(), sidecar_dir);
+    for (size_t i = 0; i < roots.size(); i++) {
+        PoRep::Location location;
+        location.record = i;
+        index.insert(roots[i], location);
+    }
+    index.publish();
+    auto snapshot = index.snapshot();
+    // Touch every entry, as a prover does over time
+    uint64_t acc = 0;
+    for (const auto& e : *snapshot)
+        acc += e.value.record;
+
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& c : challenges)
+        acc += snapshot->closest(c)->value.record;
+    auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    malloc_trim(0);
+    auto after = resident();
+    std::cout << std::left << std::setw(8) << mode << std::right << std::fixed << std::setprecision(1)
+              << " anon " << std::setw(8) << (after.first - before.first) / 1e6 << " MB"
+              << "  file " << std::setw(8) << (after.second - before.second) / 1e6 << " MB"
+              << "  closest " << std::setprecision(2) << elapsed / challenges.size() << " us"
+              << "  (" << acc % 10 << ")" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <sidecar_dir> [roots] [lookups]" << std::endl;
+        return 1;
+    }
+    std::string sidecar_dir = argv[1];
+    size_t count = argc > 2 ? std::stoull(argv[2]) : 2000000;
+    size_t lookups = argc > 3 ? std::stoull(argv[3]) : 1000000;
+    if (count == 0 || lookups == 0) {
+        std::cerr << "roots and lookups must be positive" << std::endl;
+        return 1;
+    }
+    fs::create_directories(sidecar_dir);
+
+    std::vector<PoRep::Hash> roots = random_hashes(count, 1);
+    std::vector<PoRep::Hash> challenges = random_hashes(lookups, 2);
+    std::cout << count << " roots, " << sizeof(RootIndex::Entry) << "-byte entries, "
+              << lookups << " lookups" << std::endl;
+    run("normal", "", roots, challenges);
+    run("compact", sidecar_dir, roots, challenges);
+    return 0;
+}
@@ -12,12 +12,12 @@ if __name__ == '__main__':
     dist, pvalue = chisquare(df.Frequency.values)
     print(pvalue)
     # print("Contents in csv file:", df)
-    plt.ylim(0, 20000)
+    plt.ylim(0, 2 * sum / len(df))
     plt.title("Proof distribution") 
     plt.xlabel("Buckets") 
     plt.ylabel("Frequency") 
     plt.plot(df.Bucket, df.Frequency, '.')
-    plt.axhline(y = sum/1000, color = 'r', linestyle = '-')
+    plt.axhline(y = sum/len(df), color = 'r', linestyle = '-')
     # plt.show()
     plt.savefig("distribution.pdf", format="pdf")
     # print(df.Frequency.values)
\ No newline at end of file
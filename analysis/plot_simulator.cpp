@@ -0,0 +1,206 @@
+#include "por.hpp"
+
+#include <fcntl.h>
+#include <iostream>
+#include <random>
+#include <sys/resource.h>
+
+// Usage: ./plot_simulator <plot_dir> <plots> [challenges] [threads] [options]
+// Options:
+//   --dense          fill the records with random bytes instead of leaving them sparse
+//   --reuse          prove from a store generated by an earlier run
+//   --compact-index  keep 8-byte root prefixes in memory, see PlotConfig::compact_index
+//   --cache <bytes>  top-level cache budget, see PlotConfig::cache_budget
+// Build from the repository root:
+//   g++ -O2 -I. analysis/plot_simulator.cpp -lcrypto -lpthread -o plot_simulator
+//
+// Writes <plots> fake plots straight into segment files, as compact() would
+// lay them out, then loads the store the way a prover does and proves a
+// stream of random challenges on <threads> threads. Records are random (or
+// sparse zeros), so the proofs do not verify; what is measured is the
+// index, the reads and the page cache. Sparse records take no disk space,
+// so stores far larger than the disk can be simulated.
+
+typedef por::PoRep PoRep;
+
+/// @brief Counters of /proc/self/io, zero where unavailable
+struct IoCounters {
+    uint64_t rchar = 0;
+    uint64_t syscr = 0;
+    uint64_t read_bytes = 0;
+
+    static IoCounters read() {
+        IoCounters c;
+        std::ifstream f("/proc/self/io");
+        std::string key;
+        uint64_t value;
+        while (f >> key >> value) {
+            if (key == "rchar:")
+                c.rchar = value;
+            else if (key == "syscr:")
+                c.syscr = value;
+            else if (key == "read_bytes:")
+                c.read_bytes = value;
+        }
+        return c;
+    }
+};
+
+static size_t resident_bytes() {
+    std::ifstream f("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    f >> pages >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static long major_faults() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_majflt;
+}
+
+/// @brief Writes segment @p segment holding @p records fake plots
+static void generate_segment(const PoRep& p, uint32_t segment, size_t records, bool dense) {
+    std::mt19937_64 rng(segment);
+    std::string path = p.segment_path(segment);
+    size_t size = p.plot_file_size();
+
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::runtime_error("Cannot create " + path);
+    if (dense) {
+        std::vector<uint64_t> record((size + 7) / 8);
+        for (size_t r = 0; r < records; r++) {
+            for (auto& w : record)
+                w = rng();
+            if (pwrite(fd, record.data(), size, r * size) != (ssize_t)size)
+                throw std::runtime_error("Cannot write " + path);
+        }
+    }
+    else if (ftruncate(fd, records * size) != 0) {
+        throw std::runtime_error("Cannot size " + path);
+    }
+    close(fd);
+
+    std::string roots;
+    roots.reserve(records * (2 * sizeof(PoRep::Hash) + 1));
+    PoRep::Hash root;
+    for (size_t r = 0; r < records; r++) {
+        for (auto& b : root.bytes)
+            b = rng();
+        roots += root.to_string();
+        roots += '\n';
+    }
+    por::write_atomically(path + ".roots", roots);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cout << "Usage: " << argv[0] << " <plot_dir> <plots> [challenges] [threads] [--dense] [--reuse] [--compact-index] [--cache <bytes>]\n";
+        return 1;
+    }
+    por::PlotConfig config;
+    config.plot_dir = argv[1];
+    size_t plots = std::stoul(argv[2]);
+    size_t challenges = 100000;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    bool dense = false, reuse = false;
+
+    std::vector<std::string> positional;
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--dense")
+            dense = true;
+        else if (arg == "--reuse")
+            reuse = true;
+        else if (arg == "--compact-index")
+            config.compact_index = true;
+        else if (arg == "--cache" && i + 1 < argc)
+            config.cache_budget = std::stoul(argv[++i]);
+        else
+            positional.push_back(arg);
+    }
+    if (positional.size() > 0)
+        challenges = std::stoul(positional[0]);
+    if (positional.size() > 1)
+        threads = std::stoul(positional[1]);
+
+    if (!reuse) {
+        fs::remove_all(config.plot_dir);
+        fs::create_directories(config.plot_dir);
+        PoRep writer(config);
+        size_t segments = (plots + config.segment_records - 1) / config.segment_records;
+        std::atomic<size_t> next(0);
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; t++) {
+            workers.emplace_back([&]() {
+                for (size_t s = next++; s < segments; s = next++)
+                    generate_segment(writer, s, std::min(config.segment_records, plots - s * config.segment_records), dense);
+            });
+        }
+        for (auto& w : workers)
+            w.join();
+        por::fsync_path(config.plot_dir);
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        std::cout << "Generated " << plots << " plots in " << segments << " segments ("
+                  << plots * writer.plot_file_size() / (1 << 20) << " MiB" << (dense ? "" : " sparse") << ")" << std::endl;
+        std::cout << "Generation time = " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << "[ms]" << std::endl;
+    }
+
+    size_t resident = resident_bytes();
+    PoRep p(config);
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    p.load_plot(config.plot_dir);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    std::cout << "Roots: " << p.search.size() << std::endl;
+    std::cout << "Load time = " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << "[ms]" << std::endl;
+    std::cout << "Index memory = " << (resident_bytes() - std::min(resident, resident_bytes())) / (1 << 20) << "[MiB]" << std::endl;
+
+    std::vector<std::vector<double>> latencies(threads);
+    std::atomic<size_t> next(0);
+    IoCounters before = IoCounters::read();
+    long faults = major_faults();
+    begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            std::mt19937_64 rng(1000 + t);
+            PoRep::Hash challenge;
+            latencies[t].reserve(challenges / threads + 1);
+            while (next++ < challenges) {
+                for (auto& b : challenge.bytes)
+                    b = rng();
+                std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+                p.generate_proof(challenge);
+                std::chrono::steady_clock::time_point received = std::chrono::steady_clock::now();
+                latencies[t].push_back(std::chrono::duration<double, std::micro>(received - sent).count());
+            }
+        });
+    }
+    for (auto& w : workers)
+        w.join();
+    end = std::chrono::steady_clock::now();
+    IoCounters after = IoCounters::read();
+    faults = major_faults() - faults;
+
+    std::vector<double> all;
+    for (const auto& l : latencies)
+        all.insert(all.end(), l.begin(), l.end());
+    std::sort(all.begin(), all.end());
+    auto percentile = [&](double q) {
+        return all.empty() ? 0.0 : all[std::min(all.size() - 1, static_cast<size_t>(q * all.size()))];
+    };
+    double n = std::max<size_t>(all.size(), 1);
+
+    double seconds = std::chrono::duration<double>(end - begin).count();
+    std::cout << "Proofs: " << all.size() << " on " << threads << " threads" << std::endl;
+    std::cout << "Throughput: " << all.size() / seconds << " proofs/s" << std::endl;
+    std::cout << "p50 = " << percentile(0.50) << "[us]" << std::endl;
+    std::cout << "p99 = " << percentile(0.99) << "[us]" << std::endl;
+    std::cout << "p999 = " << percentile(0.999) << "[us]" << std::endl;
+    std::cout << "Read calls per proof = " << (after.syscr - before.syscr) / n << std::endl;
+    std::cout << "Bytes read per proof = " << (after.rchar - before.rchar) / n << std::endl;
+    std::cout << "Storage bytes per proof = " << (after.read_bytes - before.read_bytes) / n << std::endl;
+    std::cout << "Major faults = " << faults << std::endl;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace merkle {
+
+  /// @brief Allocator for large, long-lived buffers such as tree nodes
+  ///
+  /// Buffers of at least MAP_THRESHOLD bytes are mapped directly from the
+  /// kernel and, when huge pages are requested, advised as transparent huge
+  /// pages so big trees need fewer TLB entries. Smaller buffers come from
+  /// operator new. Workers keep their buffers across chunks, so in steady
+  /// state neither path is hit.
+  /// @tparam T Type of the elements
+  template <class T>
+  struct PageAllocator
+  {
+    typedef T value_type;
+
+    /// @brief Size of a transparent huge page on x86-64 and arm64
+    static constexpr size_t HUGE_PAGE = 1 << 21;
+
+    /// @brief Buffers from this size on are mapped instead of allocated
+    static constexpr size_t MAP_THRESHOLD = HUGE_PAGE;
+
+    /// @brief Constructs an allocator
+    /// @param huge_pages Advise mapped buffers as huge pages
+    PageAllocator(bool huge_pages = false) : huge_pages(huge_pages) {}
+
+    template <class U>
+    PageAllocator(const PageAllocator<U>& other) : huge_pages(other.huge_pages) {}
+
+    T* allocate(size_t n)
+    {
+      size_t bytes = n * sizeof(T);
+      if (bytes < MAP_THRESHOLD)
+        return static_cast<T*>(::operator new(bytes));
+
+      // Map a huge page more than needed and trim it, so the buffer starts on
+      // a huge page boundary and every page of it can be a huge page
+      size_t size = mapped_size(bytes);
+      void* mapping = mmap(nullptr, size + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (mapping == MAP_FAILED)
+        throw std::bad_alloc();
+      char* first = static_cast<char*>(mapping);
+      char* p = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(first) + HUGE_PAGE - 1) & ~(uintptr_t)(HUGE_PAGE - 1));
+      if (p > first)
+        munmap(first, p - first);
+      if (first + HUGE_PAGE > p)
+        munmap(p + size, first + HUGE_PAGE - p);
+#ifdef MADV_HUGEPAGE
+      if (huge_pages)
+        madvise(p, size, MADV_HUGEPAGE);
+#endif
+      return reinterpret_cast<T*>(p);
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+      size_t bytes = n * sizeof(T);
+      if (bytes < MAP_THRESHOLD)
+        ::operator delete(p);
+      else
+        munmap(p, mapped_size(bytes));
+    }
+
+    template <class U>
+    bool operator==(const PageAllocator<U>& other) const
+    {
+      return huge_pages == other.huge_pages;
+    }
+
+    template <class U>
+    bool operator!=(const PageAllocator<U>& other) const
+    {
+      return huge_pages != other.huge_pages;
+    }
+
+    bool huge_pages;
+
+  private:
+    /// @brief Mappings are whole huge pages so they can be backed by them
+    static size_t mapped_size(size_t bytes)
+    {
+      return (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+    }
+  };
+}
@@ -0,0 +1,40 @@
+#include "por.hpp"
+#include <iostream>
+#include <chrono>
+
+// Usage: ./audit [plot_dir] [threads] [--quarantine]
+int main(int argc, char** argv) {
+    por::PlotConfig config;
+    size_t threads = 0;
+    bool quarantine = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "--quarantine")
+            quarantine = true;
+        else if (i == 1)
+            config.plot_dir = arg;
+        else
+            threads = std::stoul(arg);
+    }
+
+    por::PoRepT<32, merkle::sha256, 2, 64> p(config);
+    p.load_plot(config.plot_dir);
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    por::AuditReport report = p.audit(threads, quarantine);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    for (const std::string& file : report.corrupt)
+        std::cout << "corrupt " << file << std::endl;
+    for (const std::string& file : report.orphans)
+        std::cout << "orphan " << file << std::endl;
+    for (const std::string& file : report.missing)
+        std::cout << "missing " << file << std::endl;
+
+    std::cout << "Checked: " << report.checked << std::endl;
+    std::cout << "Corrupt: " << report.corrupt.size() << std::endl;
+    std::cout << "Orphans: " << report.orphans.size() << std::endl;
+    std::cout << "Execution time = " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << "[ms]" << std::endl;
+
+    return report.clean() ? 0 : 1;
+}
@@ -0,0 +1,363 @@
+#pragma once
+
+#include "por.hpp"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <sys/eventfd.h>
+
+namespace por {
+
+    /// @brief Plot call running on its own thread, polled instead of calling back
+    class PlotTask {
+        public:
+            /// @brief Starts @p run
+            /// @param run The plot call, returning the salt of the encryption IV
+            /// @param progress Progress of the prover @p run plots with
+            /// @param keep_alive Released only after the thread has finished
+            PlotTask(std::function<uint64_t()> run, const Progress& progress, std::shared_ptr<void> keep_alive = nullptr) :
+                progress(progress), keep_alive(std::move(keep_alive))
+            {
+                thread = std::thread([this, run]() {
+                    std::exception_ptr e;
+                    uint64_t s = 0;
+                    try {
+                        s = run();
+                    }
+                    catch (...) {
+                        e = std::current_exception();
+                    }
+                    std::lock_guard<std::mutex> lock(m);
+                    error = e;
+                    salt = s;
+                    finished = true;
+                    cv.notify_all();
+                });
+            }
+
+            PlotTask(const PlotTask&) = delete;
+            PlotTask& operator=(const PlotTask&) = delete;
+
+            /// @brief Waits for the plot call to finish
+            ~PlotTask() {
+                thread.join();
+            }
+
+            /// @brief Whether the plot call has finished
+            bool done() {
+                std::lock_guard<std::mutex> lock(m);
+                return finished;
+            }
+
+            /// @brief Chunks plotted so far and in total
+            std::pair<uint64_t, uint64_t> chunks() const {
+                return {progress.done.load(), progress.total.load()};
+            }
+
+            /// @brief Waits for the plot call
+            /// @param seconds Longest wait, negative to wait forever
+            /// @return Whether the plot call has finished
+            bool wait(double seconds = -1) {
+                std::unique_lock<std::mutex> lock(m);
+                if (seconds < 0)
+                    cv.wait(lock, [this]() { return finished; });
+                else
+                    cv.wait_for(lock, std::chrono::duration<double>(seconds), [this]() { return finished; });
+                return finished;
+            }
+
+            /// @brief Waits for the plot call and rethrows its error, if any
+            /// @return Salt of the encryption IV, see PoRepT::plot
+            uint64_t result() {
+                wait();
+                std::lock_guard<std::mutex> lock(m);
+                if (error)
+                    std::rethrow_exception(error);
+                return salt;
+            }
+
+        private:
+            const Progress& progress;
+            std::shared_ptr<void> keep_alive;
+            std::mutex m;
+            std::condition_variable cv;
+            bool finished = false;
+            std::exception_ptr error;
+            uint64_t salt = 0;
+            std::thread thread;
+    };
+
+    /// @brief A prover as exposed to scripting languages
+    ///
+    /// Writer calls (plotting and loading) are serialized by a mutex, so they
+    /// may come from any thread, including PlotTask threads; proofs can be
+    /// generated concurrently with them.
+    /// @tparam PoRep The PoRepT instantiation to expose
+    template <class PoRep>
+    class PoRepSession {
+        public:
+            typedef typename PoRep::Hash Hash;
+            typedef typename PoRep::Proof Proof;
+
+            struct Metrics {
+                int plots;
+                int conflicts;
+                /// @brief Roots visible to provers
+                size_t roots;
+                /// @brief Chunks handled by the running or last plot call
+                uint64_t chunks_done;
+                uint64_t chunks_total;
+            };
+
+            PoRepSession(const PlotConfig& config) : porep(config) {
+                fs::create_directories(config.plot_dir);
+            }
+
+            /// @brief Plot calls return the salt of the encryption IV, see PoRepT::plot
+            uint64_t plot(const std::string& filename) {
+                std::lock_guard<std::mutex> lock(writer);
+                return porep.plot(const_cast<char*>(filename.c_str()));
+            }
+
+            uint64_t plot(const std::vector<std::string>& filenames, size_t threads = 0) {
+                std::lock_guard<std::mutex> lock(writer);
+                return porep.plot(filenames, threads);
+            }
+
+            uint64_t plot(const uint8_t* data, size_t size) {
+                std::lock_guard<std::mutex> lock(writer);
+                return porep.plot(data, size);
+            }
+
+            void replot(const std::string& filename) {
+                std::lock_guard<std::mutex> lock(writer);
+                porep.replot(const_cast<char*>(filename.c_str()));
+            }
+
+            /// @brief Plots a file in the background
+            std::unique_ptr<PlotTask> plot_async(const std::string& filename) {
+                return std::unique_ptr<PlotTask>(new PlotTask([this, filename]() { return plot(filename); }, porep.progress));
+            }
+
+            /// @brief Plots a buffer in the background
+            /// @param keep_alive Owner of @p data, released once plotting has finished
+            std::unique_ptr<PlotTask> plot_async(const uint8_t* data, size_t size, std::shared_ptr<void> keep_alive) {
+                return std::unique_ptr<PlotTask>(new PlotTask([this, data, size]() { return plot(data, size); }, porep.progress, std::move(keep_alive)));
+            }
+
+            /// @brief Indexes the plots in @p path, the configured plot_dir if empty
+            void load_plot(const std::string& path = "") {
+                std::lock_guard<std::mutex> lock(writer);
+                porep.load_plot(path.empty() ? porep.config.plot_dir : path);
+            }
+
+            Proof generate_proof(const Hash& challenge) {
+                return porep.generate_proof(challenge);
+            }
+
+            /// @brief Proves a batch of challenges on up to @p threads threads
+            std::vector<Proof> generate_proofs(const std::vector<Hash>& challenges, size_t threads = 0) {
+                if (threads == 0)
+                    threads = std::max(1u, std::thread::hardware_concurrency());
+                threads = std::min(threads, challenges.size());
+
+                std::vector<Proof> proofs(challenges.size());
+                std::atomic<size_t> next(0);
+                std::exception_ptr error;
+                std::mutex m;
+                auto work = [&]() {
+                    try {
+                        for (size_t i = next++; i < challenges.size(); i = next++)
+                            proofs[i] = porep.generate_proof(challenges[i]);
+                    }
+                    catch (...) {
+                        std::lock_guard<std::mutex> lock(m);
+                        error = std::current_exception();
+                        next = challenges.size();
+                    }
+                };
+                std::vector<std::thread> workers;
+                for (size_t t = 1; t < threads; t++)
+                    workers.emplace_back(work);
+                if (threads > 0)
+                    work();
+                for (auto& w : workers)
+                    w.join();
+                if (error)
+                    std::rethrow_exception(error);
+                return proofs;
+            }
+
+            bool verify(const Proof& proof, const Hash& challenge) {
+                return porep.verify(proof, challenge);
+            }
+
+            Metrics metrics() const {
+                return Metrics{porep.plots, porep.conflicts, porep.search.snapshot()->size(),
+                               porep.progress.done.load(), porep.progress.total.load()};
+            }
+
+            const PlotConfig& config() const {
+                return porep.config;
+            }
+
+        private:
+            PoRep porep;
+            std::mutex writer;
+    };
+
+    /// @brief Proves and verifies batches on a pool of threads, signalling
+    /// completions through an eventfd
+    ///
+    /// Meant for event loops: submit() returns at once with a ticket, fd()
+    /// becomes readable when operations finish and poll() hands them over.
+    /// Each batch is split into single challenges shared by all workers, so
+    /// any number of operations can be in flight without a thread each.
+    /// @tparam PoRep The PoRepT instantiation of the session
+    template <class PoRep>
+    class AsyncProverT {
+        public:
+            typedef typename PoRep::Hash Hash;
+            typedef typename PoRep::Proof Proof;
+
+            /// @brief A submitted batch
+            struct Operation {
+                uint64_t ticket;
+                /// @brief Whether the proofs are verified rather than generated
+                bool verifying;
+                std::vector<Hash> challenges;
+                std::vector<Proof> proofs;
+                std::vector<uint8_t> valid;
+                /// @brief First error of the batch, if any
+                std::exception_ptr error;
+                size_t remaining;
+            };
+
+            /// @param session Prover the batches run on, which must outlive the pool
+            /// @param threads Pool size, the hardware concurrency if 0
+            AsyncProverT(PoRepSession<PoRep>& session, size_t threads = 0) : session(session) {
+                event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (event < 0)
+                    throw std::runtime_error("Cannot create eventfd");
+                if (threads == 0)
+                    threads = std::max(1u, std::thread::hardware_concurrency());
+                for (size_t t = 0; t < threads; t++)
+                    workers.emplace_back(&AsyncProverT::run, this);
+            }
+
+            AsyncProverT(const AsyncProverT&) = delete;
+            AsyncProverT& operator=(const AsyncProverT&) = delete;
+
+            /// @brief Finishes the submitted operations and stops
+            ~AsyncProverT() {
+                {
+                    std::lock_guard<std::mutex> lock(m);
+                    stopping = true;
+                }
+                cv.notify_all();
+                for (auto& w : workers)
+                    w.join();
+                close(event);
+            }
+
+            /// @brief Descriptor readable while finished operations wait for poll()
+            int fd() const {
+                return event;
+            }
+
+            /// @brief Queues the proofs of @p challenges
+            /// @return Ticket of the operation
+            uint64_t submit_proofs(std::vector<Hash> challenges) {
+                auto op = std::make_shared<Operation>();
+                op->verifying = false;
+                op->proofs.resize(challenges.size());
+                op->challenges = std::move(challenges);
+                return submit(op);
+            }
+
+            /// @brief Queues the verification of @p proofs against @p challenges
+            /// @return Ticket of the operation
+            uint64_t submit_verify(std::vector<Proof> proofs, std::vector<Hash> challenges) {
+                if (proofs.size() != challenges.size())
+                    throw std::runtime_error("Every proof needs a challenge");
+                auto op = std::make_shared<Operation>();
+                op->verifying = true;
+                op->valid.resize(challenges.size());
+                op->proofs = std::move(proofs);
+                op->challenges = std::move(challenges);
+                return submit(op);
+            }
+
+            /// @brief Takes the finished operations, clearing fd()
+            std::vector<std::shared_ptr<Operation>> poll() {
+                uint64_t count;
+                while (read(event, &count, sizeof(count)) < 0 && errno == EINTR);
+                std::lock_guard<std::mutex> lock(m);
+                std::vector<std::shared_ptr<Operation>> ready;
+                ready.swap(finished);
+                return ready;
+            }
+
+        private:
+            uint64_t submit(std::shared_ptr<Operation> op) {
+                op->remaining = op->challenges.size();
+                std::lock_guard<std::mutex> lock(m);
+                op->ticket = next_ticket++;
+                if (op->challenges.empty()) {
+                    complete(op);
+                    return op->ticket;
+                }
+                for (size_t i = 0; i < op->challenges.size(); i++)
+                    queue.emplace_back(op, i);
+                cv.notify_all();
+                return op->ticket;
+            }
+
+            /// @brief Publishes @p op, with m held
+            void complete(const std::shared_ptr<Operation>& op) {
+                finished.push_back(op);
+                uint64_t one = 1;
+                while (write(event, &one, sizeof(one)) < 0 && errno == EINTR);
+            }
+
+            void run() {
+                std::unique_lock<std::mutex> lock(m);
+                while (true) {
+                    cv.wait(lock, [this]() { return stopping || !queue.empty(); });
+                    if (queue.empty())
+                        return;
+                    std::shared_ptr<Operation> op = std::move(queue.front().first);
+                    size_t i = queue.front().second;
+                    queue.pop_front();
+                    lock.unlock();
+
+                    std::exception_ptr error;
+                    try {
+                        if (op->verifying)
+                            op->valid[i] = session.verify(op->proofs[i], op->challenges[i]);
+                        else
+                            op->proofs[i] = session.generate_proof(op->challenges[i]);
+                    }
+                    catch (...) {
+                        error = std::current_exception();
+                    }
+
+                    lock.lock();
+                    if (error && !op->error)
+                        op->error = error;
+                    if (--op->remaining == 0)
+                        complete(op);
+                }
+            }
+
+            PoRepSession<PoRep>& session;
+            int event;
+            std::mutex m;
+            std::condition_variable cv;
+            std::deque<std::pair<std::shared_ptr<Operation>, size_t>> queue;
+            std::vector<std::shared_ptr<Operation>> finished;
+            uint64_t next_ticket = 0;
+            bool stopping = false;
+            std::vector<std::thread> workers;
+    };
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace por {
+
+    /// @brief AES-256-CTR keystream applied to input chunks in place
+    ///
+    /// The counter of each 16-byte block is the IV plus the block's position
+    /// in the input, so chunks can be encrypted independently and in any
+    /// order, and the result equals encrypting the whole input with
+    /// `openssl enc -aes-256-ctr -K <key> -iv <iv>`. Inputs sharing a key
+    /// must not share a keystream, so each input gets its own IV from
+    /// salted_iv().
+    class ChunkCipher {
+        public:
+            static constexpr size_t KEY_SIZE = 32;
+            static constexpr size_t BLOCK_SIZE = 16;
+
+            /// @brief Constructs a cipher
+            /// @param key 32-byte AES-256 key
+            /// @param iv 16-byte initial counter block
+            ChunkCipher(const std::vector<uint8_t>& key, const std::vector<uint8_t>& iv) :
+                key(key), iv(iv), ctx(EVP_CIPHER_CTX_new())
+            {
+                if (key.size() != KEY_SIZE || iv.size() != BLOCK_SIZE)
+                    throw std::runtime_error("Encryption needs a 32-byte key and a 16-byte IV");
+                if (ctx == nullptr)
+                    throw std::runtime_error("Cannot create cipher context");
+            }
+
+            ChunkCipher(const ChunkCipher&) = delete;
+            ChunkCipher& operator=(const ChunkCipher&) = delete;
+
+            ~ChunkCipher() {
+                EVP_CIPHER_CTX_free(ctx);
+            }
+
+            /// @brief A random salt for salted_iv()
+            static uint64_t random_salt() {
+                uint8_t bytes[sizeof(uint64_t)];
+                if (RAND_bytes(bytes, sizeof(bytes)) != 1)
+                    throw std::runtime_error("Cannot draw a random salt");
+                uint64_t salt = 0;
+                for (uint8_t b : bytes)
+                    salt = salt << 8 | b;
+                return salt;
+            }
+
+            /// @brief The IV of one input: @p iv with @p salt XORed into its top 64 bits
+            ///
+            /// The block position is added to the low bits, so inputs with
+            /// different salts use disjoint counter ranges. A salt of 0 keeps @p iv.
+            static std::vector<uint8_t> salted_iv(std::vector<uint8_t> iv, uint64_t salt) {
+                for (size_t i = 0; i < sizeof(uint64_t) && i < iv.size(); i++)
+                    iv[i] ^= static_cast<uint8_t>(salt >> (8 * (sizeof(uint64_t) - 1 - i)));
+                return iv;
+            }
+
+            /// @brief Encrypts or decrypts @p n bytes in place
+            /// @param data Bytes to transform
+            /// @param n Number of bytes
+            /// @param position Position of @p data in the input, a multiple of BLOCK_SIZE
+            void apply(uint8_t* data, size_t n, uint64_t position) {
+                if (position % BLOCK_SIZE != 0)
+                    throw std::runtime_error("Cipher position must be block aligned");
+
+                // 128-bit big-endian addition of the block number to the IV
+                uint8_t counter[BLOCK_SIZE];
+                uint64_t carry = position / BLOCK_SIZE;
+                for (size_t i = BLOCK_SIZE; i-- > 0;) {
+                    carry += iv[i];
+                    counter[i] = static_cast<uint8_t>(carry);
+                    carry >>= 8;
+                }
+
+                int len = 0;
+                if (EVP_EncryptInit_ex(ctx, EVP_aes_256_ctr(), nullptr, key.data(), counter) != 1 ||
+                    EVP_EncryptUpdate(ctx, data, &len, data, static_cast<int>(n)) != 1)
+                    throw std::runtime_error("Cannot encrypt chunk");
+            }
+
+        private:
+            std::vector<uint8_t> key;
+            std::vector<uint8_t> iv;
+            EVP_CIPHER_CTX* ctx;
+    };
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+
+namespace por {
+
+    /// @brief Flushes a file or directory to stable storage
+    static inline void fsync_path(const std::string& path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open " + path + " to sync it");
+        int r = fsync(fd);
+        close(fd);
+        if (r != 0)
+            throw std::runtime_error("Cannot sync " + path);
+    }
+
+    /// @brief Replaces a file so that readers and crashes see either the old or the new contents
+    /// @param path File to replace
+    /// @param contents New contents
+    static inline void write_atomically(const std::string& path, const std::string& contents)
+    {
+        std::string tmp = path + ".tmp";
+        int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            throw std::runtime_error("Cannot write " + tmp);
+
+        size_t written = 0;
+        while (written < contents.size()) {
+            ssize_t n = write(fd, contents.data() + written, contents.size() - written);
+            if (n < 0) {
+                close(fd);
+                throw std::runtime_error("Cannot write " + tmp);
+            }
+            written += n;
+        }
+        int r = fsync(fd);
+        close(fd);
+        if (r != 0 || rename(tmp.c_str(), path.c_str()) != 0)
+            throw std::runtime_error("Cannot replace " + path);
+
+        std::string dir = std::filesystem::path(path).parent_path();
+        fsync_path(dir.empty() ? "." : dir);
+    }
+
+    /// @brief Writes a file that must not exist yet, in as few system calls as possible
+    /// @param path File to create
+    /// @param data, size Contents
+    ///
+    /// Not synced; a crash can leave a torn file, which callers detect by its
+    /// size. A failed write removes the file so it can be written again.
+    static inline void write_new_file(const std::string& path, const void* data, size_t size)
+    {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd < 0)
+            throw std::runtime_error(errno == EEXIST ? "Cannot serialize with given filename" : "Cannot write " + path);
+
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t n = write(fd, p, size);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0) {
+                close(fd);
+                unlink(path.c_str());
+                throw std::runtime_error("Cannot write " + path);
+            }
+            p += n;
+            size -= n;
+        }
+        if (close(fd) != 0) {
+            unlink(path.c_str());
+            throw std::runtime_error("Cannot write " + path);
+        }
+    }
+}
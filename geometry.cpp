@@ -0,0 +1,47 @@
+#include "geometry.hpp"
+
+namespace por {
+
+    template <size_t FANOUT, size_t LEAVES>
+    static std::unique_ptr<DynamicPoRep> make_sha256(const Geometry& geometry, const PlotConfig& config) {
+        return std::unique_ptr<DynamicPoRep>(new DynamicPoRepT<PoRepT<32, merkle::sha256, FANOUT, LEAVES>>(geometry, config));
+    }
+
+    /// @brief Supported geometries, each compiled here once
+    static const struct {
+        size_t fanout;
+        size_t leaves;
+        const char* hash;
+        std::unique_ptr<DynamicPoRep> (*make)(const Geometry&, const PlotConfig&);
+    } registry[] = {
+        {2, 64, "sha256", make_sha256<2, 64>},
+        {2, 1024, "sha256", make_sha256<2, 1024>},
+        {2, 16384, "sha256", make_sha256<2, 16384>},
+        {2, 1 << 20, "sha256", make_sha256<2, 1 << 20>},
+        {4, 64, "sha256", make_sha256<4, 64>},
+        {4, 1024, "sha256", make_sha256<4, 1024>},
+        {4, 16384, "sha256", make_sha256<4, 16384>},
+        {4, 1 << 20, "sha256", make_sha256<4, 1 << 20>},
+        {8, 64, "sha256", make_sha256<8, 64>},
+        {8, 4096, "sha256", make_sha256<8, 4096>},
+        {8, 1 << 18, "sha256", make_sha256<8, 1 << 18>},
+    };
+
+    std::vector<Geometry> geometries() {
+        std::vector<Geometry> all;
+        for (const auto& r : registry)
+            all.push_back(Geometry{r.fanout, r.leaves, r.hash});
+        return all;
+    }
+
+    std::unique_ptr<DynamicPoRep> make_porep(const Geometry& geometry, const PlotConfig& config) {
+        for (const auto& r : registry) {
+            if (r.fanout == geometry.fanout && r.leaves == geometry.leaves && r.hash == geometry.hash)
+                return r.make(geometry, config);
+        }
+        std::string supported;
+        for (const auto& g : geometries())
+            supported += " " + g.to_string();
+        throw std::runtime_error("Unsupported geometry " + geometry.to_string() + ", supported:" + supported);
+    }
+}
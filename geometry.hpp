@@ -0,0 +1,150 @@
+#pragma once
+
+#include "por.hpp"
+
+namespace por {
+
+    /// @brief Shape of the trees a prover plots
+    struct Geometry {
+        size_t fanout = 2;
+        size_t leaves = 64;
+        std::string hash = "sha256";
+
+        /// @brief Formats as "<fanout>x<leaves>:<hash>"
+        std::string to_string() const {
+            return std::to_string(fanout) + "x" + std::to_string(leaves) + ":" + hash;
+        }
+
+        /// @brief Parses "<fanout>x<leaves>", optionally followed by ":<hash>"
+        static Geometry parse(const std::string& s) {
+            Geometry g;
+            size_t x = s.find('x');
+            size_t colon = s.find(':');
+            if (x == std::string::npos || x == 0 || x + 1 >= std::min(colon, s.size()))
+                throw std::runtime_error("Invalid geometry " + s);
+            try {
+                g.fanout = std::stoul(s.substr(0, x));
+                g.leaves = std::stoul(s.substr(x + 1, colon == std::string::npos ? std::string::npos : colon - x - 1));
+            }
+            catch (const std::logic_error&) {
+                throw std::runtime_error("Invalid geometry " + s);
+            }
+            if (colon != std::string::npos)
+                g.hash = s.substr(colon + 1);
+            return g;
+        }
+
+        bool operator==(const Geometry& other) const {
+            return fanout == other.fanout && leaves == other.leaves && hash == other.hash;
+        }
+    };
+
+    /// @brief Proof of a DynamicPoRep, the geometry erased
+    struct DynamicProof {
+        std::vector<merkle::HashT<32>> hashes;
+
+        std::string to_string() const {
+            std::string s;
+            for (const auto& h : hashes)
+                s += h.to_string();
+            return s;
+        }
+
+        /// @brief Size of the proof on the wire
+        size_t bytes() const {
+            return hashes.size() * sizeof(merkle::HashT<32>);
+        }
+    };
+
+    /// @brief Prover whose geometry is picked at runtime
+    ///
+    /// Every supported geometry is a PoRepT instantiation compiled once in
+    /// geometry.cpp, so plotting and proving run the same specialized code
+    /// as a PoRepT used directly; only the calls below are virtual.
+    class DynamicPoRep {
+        public:
+            typedef merkle::HashT<32> Hash;
+
+            virtual ~DynamicPoRep() {}
+
+            virtual Geometry geometry() const = 0;
+            virtual const PlotConfig& config() const = 0;
+            /// @brief Input bytes per tree
+            virtual size_t chunk_size() const = 0;
+            /// @brief Hashes per proof
+            virtual size_t proof_hashes() const = 0;
+            /// @brief Bytes of every plot on disk
+            virtual size_t plot_file_size() const = 0;
+
+            /// @brief Plot calls return the salt of the encryption IV, see PoRepT::plot
+            virtual uint64_t plot(const std::string& filename) = 0;
+            virtual uint64_t plot(const std::vector<std::string>& filenames, size_t threads = 0) = 0;
+            virtual uint64_t plot(const uint8_t* data, size_t size) = 0;
+            virtual void replot(const std::string& filename) = 0;
+            virtual void load_plot(const std::string& path) = 0;
+            virtual AuditReport audit(size_t threads = 0, bool quarantine = false) = 0;
+            virtual CompactionReport compact() = 0;
+
+            virtual DynamicProof generate_proof(const Hash& challenge) = 0;
+            virtual bool verify(const DynamicProof& proof, const Hash& challenge) = 0;
+
+            virtual int get_plots() = 0;
+            virtual int get_conflicts() = 0;
+            /// @brief Roots visible to provers
+            virtual size_t roots() const = 0;
+            virtual const Progress& progress() const = 0;
+    };
+
+    /// @brief DynamicPoRep forwarding to a PoRepT
+    /// @tparam PoRep The PoRepT instantiation
+    template <class PoRep>
+    class DynamicPoRepT : public DynamicPoRep {
+        public:
+            DynamicPoRepT(const Geometry& geometry, const PlotConfig& config) : shape(geometry), porep(config) {}
+
+            Geometry geometry() const override { return shape; }
+            const PlotConfig& config() const override { return porep.config; }
+            size_t chunk_size() const override { return PoRep::CHUNK_SIZE; }
+            size_t proof_hashes() const override { return PoRep::Proof::n; }
+            size_t plot_file_size() const override { return porep.plot_file_size(); }
+
+            uint64_t plot(const std::string& filename) override { return porep.plot(const_cast<char*>(filename.c_str())); }
+            uint64_t plot(const std::vector<std::string>& filenames, size_t threads) override { return porep.plot(filenames, threads); }
+            uint64_t plot(const uint8_t* data, size_t size) override { return porep.plot(data, size); }
+            void replot(const std::string& filename) override { porep.replot(const_cast<char*>(filename.c_str())); }
+            void load_plot(const std::string& path) override { porep.load_plot(path); }
+            AuditReport audit(size_t threads, bool quarantine) override { return porep.audit(threads, quarantine); }
+            CompactionReport compact() override { return porep.compact(); }
+
+            DynamicProof generate_proof(const Hash& challenge) override {
+                return DynamicProof{porep.generate_proof(challenge).hashes};
+            }
+
+            bool verify(const DynamicProof& proof, const Hash& challenge) override {
+                typename PoRep::Proof p;
+                if (proof.hashes.size() != p.n)
+                    return false;
+                p.hashes = proof.hashes;
+                return porep.verify(p, challenge);
+            }
+
+            int get_plots() override { return porep.get_plots(); }
+            int get_conflicts() override { return porep.get_conflicts(); }
+            size_t roots() const override { return porep.search.snapshot()->size(); }
+            const Progress& progress() const override { return porep.progress; }
+
+            /// @brief The underlying prover
+            PoRep& get() { return porep; }
+
+        private:
+            Geometry shape;
+            PoRep porep;
+    };
+
+    /// @brief Geometries make_porep() supports
+    std::vector<Geometry> geometries();
+
+    /// @brief Constructs a prover of @p geometry
+    /// @throws std::runtime_error if @p geometry is not among geometries()
+    std::unique_ptr<DynamicPoRep> make_porep(const Geometry& geometry, const PlotConfig& config = PlotConfig());
+}
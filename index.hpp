@@ -0,0 +1,454 @@
+#pragma once
+
+#include "trace.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace por {
+
+    /// @brief Sorted index of plot roots with lock-free readers and a single writer
+    ///
+    /// Readers take an immutable snapshot without locks and search it. The
+    /// writer collects new roots in a pending batch and publishes a merged
+    /// snapshot once the batch is large enough, so publishing costs
+    /// amortized O(1) copies per root, or once the oldest pending change has
+    /// waited for the configured delay, which bounds how long a new root
+    /// stays invisible to provers. Bulk loads skip the pending batch: they
+    /// are sorted and merged into a new snapshot in one pass. Old snapshots
+    /// are freed when the last reader holding them lets go.
+    ///
+    /// The published snapshot is swapped with an epoch scheme rather than
+    /// std::atomic_load on a shared_ptr, which takes a lock from a global
+    /// pool: a reader announces itself on the counter of the current epoch
+    /// while it copies the pointer, and the writer frees the previous
+    /// pointer only after both epoch counters have drained.
+    ///
+    /// In compact mode a snapshot keeps only the top 64 bits of every root in
+    /// memory. The full entries go to an unlinked sidecar file that is mapped
+    /// read-only, so they live in the page cache and are only touched for the
+    /// few entries a search ends on.
+    /// @tparam Hash The type of the roots
+    /// @tparam Value Data stored next to each root
+    template <class Hash, class Value>
+    class RootIndexT {
+        public:
+            /// @brief A root and its data
+            struct Entry {
+                Hash root;
+                Value value;
+            };
+
+            /// @brief Immutable sorted view of the index
+            struct Snapshot {
+                Snapshot() = default;
+                Snapshot(const Snapshot&) = delete;
+                Snapshot& operator=(const Snapshot&) = delete;
+
+                ~Snapshot() {
+                    if (mapping != nullptr)
+                        munmap(mapping, count * sizeof(Entry));
+                }
+
+                size_t size() const {
+                    return count;
+                }
+
+                const Entry* begin() const {
+                    return data;
+                }
+
+                const Entry* end() const {
+                    return data + count;
+                }
+
+                /// @brief Finds a root
+                /// @return The entry or nullptr
+                const Entry* find(const Hash& root) const {
+                    auto it = lower_bound(root);
+                    return it != end() && it->root == root ? it : nullptr;
+                }
+
+                /// @brief Finds the root closest to @p value, ties going to the smaller root
+                /// @return The entry or nullptr if the snapshot is empty
+                const Entry* closest(const Hash& value) const {
+                    if (count == 0)
+                        return nullptr;
+
+                    const Entry* it = lower_bound(value);
+                    if (it == begin())
+                        return it;
+
+                    const Entry* prev_it = it - 1;
+                    return (it == end() || value - prev_it->root <= it->root - value) ? prev_it : it;
+                }
+
+                const Entry* lower_bound(const Hash& value) const {
+                    const Entry* first = begin();
+                    const Entry* last = end();
+                    if (mapping != nullptr) {
+                        // Only roots sharing the prefix of value need their full bytes
+                        uint64_t prefix = value.to_uint64();
+                        size_t i = prefix_search(prefix);
+                        size_t j = i;
+                        while (j < count && prefixes[j] == prefix)
+                            j++;
+                        first = data + i;
+                        last = data + j;
+                    }
+                    return std::lower_bound(first, last, value,
+                        [](const Entry& e, const Hash& v) { return e.root < v; });
+                }
+
+                /// @brief Entries, owned in normal mode
+                std::vector<Entry> entries;
+                /// @brief Top 64 bits of every root, compact mode only
+                std::vector<uint64_t> prefixes;
+                /// @brief Mapped sidecar with the entries, compact mode only
+                void* mapping = nullptr;
+                const Entry* data = nullptr;
+                size_t count = 0;
+
+            private:
+                /// @brief Index of the first prefix not less than @p key
+                ///
+                /// Roots are uniformly distributed, so interpolating between the
+                /// bounds takes O(log log n) steps; skewed data falls back to
+                /// bisection after a few steps.
+                size_t prefix_search(uint64_t key) const {
+                    size_t lo = 0, hi = count;
+                    for (int step = 0; step < 8 && hi - lo > 16; step++) {
+                        uint64_t a = prefixes[lo], b = prefixes[hi - 1];
+                        if (key <= a)
+                            return lo;
+                        if (key > b)
+                            return hi;
+                        size_t mid = lo + static_cast<size_t>(double(key - a) / double(b - a) * (hi - 1 - lo));
+                        if (prefixes[mid] < key)
+                            lo = mid + 1;
+                        else
+                            hi = mid;
+                    }
+                    return std::lower_bound(prefixes.begin() + lo, prefixes.begin() + hi, key) - prefixes.begin();
+                }
+            };
+
+            /// @brief Constructs an empty index
+            /// @param batch Minimum number of pending roots before maybe_publish() publishes
+            /// @param sidecar_dir Directory for the sidecar files of compact mode,
+            /// empty to keep full entries in memory
+            /// @param delay Longest time maybe_publish() holds back a pending change
+            RootIndexT(size_t batch = 1024, const std::string& sidecar_dir = "",
+                       std::chrono::milliseconds delay = std::chrono::milliseconds(1000)) :
+                batch(batch),
+                delay(delay),
+                sidecar_dir(sidecar_dir),
+                current(new Published{std::make_shared<const Snapshot>()}) {}
+
+            RootIndexT(const RootIndexT&) = delete;
+            RootIndexT& operator=(const RootIndexT&) = delete;
+
+            ~RootIndexT() {
+                delete current.load();
+            }
+
+            /// @brief The latest published snapshot, safe to call from any thread
+            std::shared_ptr<const Snapshot> snapshot() const {
+                unsigned e = epoch.load();
+                readers[e].fetch_add(1);
+                std::shared_ptr<const Snapshot> s = current.load()->snapshot;
+                readers[e].fetch_sub(1);
+                return s;
+            }
+
+            /// @brief Whether a root is published or pending (writer only)
+            bool contains(const Hash& root) const {
+                if (pending.count(root) > 0)
+                    return true;
+                return removed.count(root) == 0 && published().find(root) != nullptr;
+            }
+
+            /// @brief Adds a root, invisible to readers until published (writer only)
+            /// @return false if the root is already indexed
+            bool insert(const Hash& root, const Value& value) {
+                if (contains(root))
+                    return false;
+                add_pending(root, value);
+                return true;
+            }
+
+            /// @brief Replaces the data of an indexed root, readers see the old data until published (writer only)
+            /// @return false if the root is not indexed
+            bool assign(const Hash& root, const Value& value) {
+                auto it = pending.find(root);
+                if (it != pending.end()) {
+                    it->second = value;
+                    return true;
+                }
+                if (!contains(root))
+                    return false;
+                removed.insert(root);
+                add_pending(root, value);
+                return true;
+            }
+
+            /// @brief Removes a root, still visible to readers until published (writer only)
+            /// @return false if the root is not indexed
+            bool erase(const Hash& root) {
+                if (pending.erase(root) > 0)
+                    return true;
+                if (!contains(root))
+                    return false;
+                if (pending.empty() && removed.empty())
+                    oldest = std::chrono::steady_clock::now();
+                removed.insert(root);
+                return true;
+            }
+
+            /// @brief Publishes the pending changes once the batch is large enough
+            /// or the oldest of them has waited for the delay (writer only)
+            void maybe_publish() {
+                size_t changes = pending.size() + removed.size();
+                if (changes >= std::max(batch, published().size() / 8) ||
+                    (changes > 0 && std::chrono::steady_clock::now() - oldest >= delay))
+                    publish();
+            }
+
+            /// @brief Makes all pending insertions and removals visible to readers at once (writer only)
+            void publish() {
+                if (pending.empty() && removed.empty())
+                    return;
+                TraceScope trace("index.publish");
+
+                auto base = current.load()->snapshot;
+                Builder next(sidecar_dir, base->size() + pending.size());
+                auto it = base->begin();
+                auto keep = [&](const Entry& e) {
+                    if (removed.count(e.root) == 0)
+                        next.emit(e);
+                };
+                for (const auto& p : pending) {
+                    for (; it != base->end() && it->root < p.first; it++)
+                        keep(*it);
+                    next.emit(Entry{p.first, p.second});
+                }
+                for (; it != base->end(); it++)
+                    keep(*it);
+
+                // A failed sidecar throws with the changes still pending
+                auto snapshot = next.finish();
+                pending.clear();
+                removed.clear();
+                replace(std::move(snapshot));
+            }
+
+            /// @brief Indexes many roots at once and publishes them with the pending changes (writer only)
+            /// @param entries New entries in any order; roots already indexed and
+            /// repeats of a root after its first occurrence are skipped
+            /// @param accept Called in root order on every entry that is added, before it is published
+            ///
+            /// Sorting the batch and merging it straight into a new snapshot
+            /// avoids the per-root node of the pending map, so stores of a
+            /// hundred million plots load in a few sorted passes.
+            template <class F>
+            void bulk_insert(std::vector<Entry> entries, F accept) {
+                publish();
+                if (entries.empty())
+                    return;
+                TraceScope trace("index.bulk_insert");
+
+                auto by_root = [](const Entry& a, const Entry& b) { return a.root < b.root; };
+                std::stable_sort(entries.begin(), entries.end(), by_root);
+                entries.erase(std::unique(entries.begin(), entries.end(),
+                    [](const Entry& a, const Entry& b) { return a.root == b.root; }), entries.end());
+
+                auto base = current.load()->snapshot;
+                if (base->size() == 0 && sidecar_dir.empty()) {
+                    // Nothing to merge with, the batch becomes the snapshot
+                    for (Entry& e : entries)
+                        accept(e);
+                    auto next = std::make_shared<Snapshot>();
+                    next->entries = std::move(entries);
+                    next->data = next->entries.data();
+                    next->count = next->entries.size();
+                    replace(std::move(next));
+                    return;
+                }
+
+                Builder next(sidecar_dir, base->size() + entries.size());
+                auto it = base->begin();
+                for (Entry& e : entries) {
+                    for (; it != base->end() && it->root < e.root; it++)
+                        next.emit(*it);
+                    if (it != base->end() && it->root == e.root)
+                        continue;
+                    accept(e);
+                    next.emit(e);
+                }
+                for (; it != base->end(); it++)
+                    next.emit(*it);
+                replace(next.finish());
+            }
+
+            void bulk_insert(std::vector<Entry> entries) {
+                bulk_insert(std::move(entries), [](Entry&) {});
+            }
+
+            /// @brief Waits until no reader holds @p old any more
+            /// @param old A snapshot taken before the last publish()
+            ///
+            /// Afterwards, files of roots removed by that publish can be deleted.
+            static void wait_for_readers(std::shared_ptr<const Snapshot>& old) {
+                TraceScope trace("index.wait_for_readers");
+                while (old.use_count() > 1)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                old.reset();
+            }
+
+            /// @brief Number of indexed roots, including pending changes (writer only)
+            size_t size() const {
+                return published().size() + pending.size() - removed.size();
+            }
+
+        private:
+            /// @brief Owner of a published snapshot, freed once no reader can reach it
+            struct Published {
+                std::shared_ptr<const Snapshot> snapshot;
+            };
+
+            /// @brief The published snapshot without taking a reference (writer only)
+            const Snapshot& published() const {
+                return *current.load()->snapshot;
+            }
+
+            void add_pending(const Hash& root, const Value& value) {
+                if (pending.empty() && removed.empty())
+                    oldest = std::chrono::steady_clock::now();
+                pending.emplace(root, value);
+            }
+
+            /// @brief Publishes @p next and frees the previous owner once no reader uses it
+            void replace(std::shared_ptr<const Snapshot> next) {
+                const Published* old = current.exchange(new Published{std::move(next)});
+                // A reader may have read the epoch just before a flip and count
+                // on the other counter, so wait for both of them to drain
+                for (int flip = 0; flip < 2; flip++) {
+                    unsigned e = epoch.load();
+                    epoch.store(e ^ 1);
+                    while (readers[e].load() != 0)
+                        std::this_thread::yield();
+                }
+                delete old;
+            }
+
+            /// @brief Collects the entries of a new snapshot in root order
+            class Builder {
+                public:
+                    /// @param sidecar_dir Where to write the entries in compact mode, empty otherwise
+                    /// @param capacity Upper bound on the number of entries
+                    Builder(const std::string& sidecar_dir, size_t capacity) : next(std::make_shared<Snapshot>()) {
+                        if (sidecar_dir.empty()) {
+                            next->entries.reserve(capacity);
+                            return;
+                        }
+                        path = sidecar_dir + "/index-XXXXXX.tmp";
+                        int fd = mkstemps(&path[0], 4);
+                        if (fd < 0 || (sidecar = fdopen(fd, "w+b")) == nullptr) {
+                            if (fd >= 0) {
+                                close(fd);
+                                unlink(path.c_str());
+                            }
+                            throw std::runtime_error("Cannot create index sidecar in " + sidecar_dir);
+                        }
+                        next->prefixes.reserve(capacity);
+                    }
+
+                    Builder(const Builder&) = delete;
+                    Builder& operator=(const Builder&) = delete;
+
+                    ~Builder() {
+                        if (sidecar != nullptr) {
+                            fclose(sidecar);
+                            unlink(path.c_str());
+                        }
+                    }
+
+                    void emit(const Entry& e) {
+                        if (sidecar == nullptr) {
+                            next->entries.push_back(e);
+                            return;
+                        }
+                        written = written && fwrite(&e, sizeof(Entry), 1, sidecar) == 1;
+                        next->prefixes.push_back(e.root.to_uint64());
+                    }
+
+                    /// @brief The snapshot of the emitted entries
+                    ///
+                    /// In compact mode the sidecar is mapped and unlinked; this
+                    /// throws unless it holds every entry, since mapping past its
+                    /// end after a short write (e.g. a full disk) would fault on
+                    /// access.
+                    std::shared_ptr<Snapshot> finish() {
+                        if (sidecar == nullptr) {
+                            next->data = next->entries.data();
+                            next->count = next->entries.size();
+                            return std::move(next);
+                        }
+                        static_assert(std::is_standard_layout<Entry>::value, "Compact mode stores entries as raw bytes");
+                        Snapshot& s = *next;
+                        s.count = s.prefixes.size();
+                        struct stat st;
+                        bool ok = written && fflush(sidecar) == 0 && fstat(fileno(sidecar), &st) == 0 &&
+                            static_cast<size_t>(st.st_size) == s.count * sizeof(Entry);
+                        if (ok && s.count > 0) {
+                            void* p = mmap(nullptr, s.count * sizeof(Entry), PROT_READ, MAP_SHARED, fileno(sidecar), 0);
+                            ok = p != MAP_FAILED;
+                            if (ok) {
+                                s.mapping = p;
+                                s.data = static_cast<const Entry*>(p);
+                            }
+                        }
+                        // The mapping keeps the file alive until the snapshot is freed
+                        fclose(sidecar);
+                        sidecar = nullptr;
+                        unlink(path.c_str());
+                        if (!ok)
+                            throw std::runtime_error("Cannot write or map index sidecar " + path);
+                        return std::move(next);
+                    }
+
+                private:
+                    std::shared_ptr<Snapshot> next;
+                    FILE* sidecar = nullptr;
+                    std::string path;
+                    /// @brief Whether every entry reached the sidecar so far
+                    bool written = true;
+            };
+
+            size_t batch;
+            std::chrono::milliseconds delay;
+            /// @brief Directory of the sidecar files, empty unless in compact mode
+            std::string sidecar_dir;
+            std::map<Hash, Value> pending;
+            /// @brief Published roots to drop at the next publish
+            std::set<Hash> removed;
+            /// @brief When the oldest pending change was made
+            std::chrono::steady_clock::time_point oldest;
+            std::atomic<const Published*> current;
+            std::atomic<unsigned> epoch{0};
+            /// @brief Readers copying the published pointer, per epoch
+            mutable std::atomic<size_t> readers[2]{};
+    };
+}
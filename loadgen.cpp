@@ -0,0 +1,71 @@
+#include "prover.hpp"
+#include <iostream>
+#include <random>
+
+// Usage: ./loadgen [socket] [connections] [requests] [batch]
+int main(int argc, char** argv) {
+    std::string socket_path = argc > 1 ? argv[1] : "por.sock";
+    size_t connections = argc > 2 ? std::stoul(argv[2]) : 4;
+    size_t requests = argc > 3 ? std::stoul(argv[3]) : 10000;
+    size_t batch = argc > 4 ? std::stoul(argv[4]) : 1;
+
+    typedef por::ProverClientT<por::PoRep> Client;
+    std::vector<std::vector<double>> latencies(connections);
+    std::atomic<size_t> failed(0), invalid(0);
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < connections; t++) {
+        workers.emplace_back([&, t]() {
+            std::mt19937_64 rng(t);
+            por::PoRep verifier;
+            Client client(socket_path);
+            std::vector<por::PoRep::Hash> challenges(batch);
+            latencies[t].reserve(requests);
+            for (size_t i = 0; i < requests; i++) {
+                for (auto& c : challenges)
+                    for (auto& b : c.bytes)
+                        b = rng();
+
+                std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+                std::vector<por::PoRep::Proof> proofs;
+                try {
+                    if (batch == 1)
+                        proofs.push_back(client.prove(challenges[0]));
+                    else
+                        proofs = client.prove(challenges);
+                }
+                catch (const std::exception& e) {
+                    failed++;
+                    continue;
+                }
+                std::chrono::steady_clock::time_point received = std::chrono::steady_clock::now();
+                latencies[t].push_back(std::chrono::duration<double, std::micro>(received - sent).count());
+
+                // Spot check outside the timed section
+                if (i % 64 == 0 && !verifier.verify(proofs[0], challenges[0]))
+                    invalid++;
+            }
+        });
+    }
+    for (auto& w : workers)
+        w.join();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    std::vector<double> all;
+    for (const auto& l : latencies)
+        all.insert(all.end(), l.begin(), l.end());
+    std::sort(all.begin(), all.end());
+    auto percentile = [&](double p) {
+        return all.empty() ? 0.0 : all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))];
+    };
+
+    double seconds = std::chrono::duration<double>(end - begin).count();
+    std::cout << "Requests: " << all.size() << " (" << failed << " failed, " << invalid << " invalid)" << std::endl;
+    std::cout << "Throughput: " << all.size() * batch / seconds << " proofs/s" << std::endl;
+    std::cout << "p50 = " << percentile(0.50) << "[us]" << std::endl;
+    std::cout << "p99 = " << percentile(0.99) << "[us]" << std::endl;
+    std::cout << "p999 = " << percentile(0.999) << "[us]" << std::endl;
+
+    return failed == 0 && invalid == 0 ? 0 : 1;
+}
@@ -6,6 +6,7 @@
 #include <fstream>
 #include <array>
 #include <iostream>
+#include "arena.hpp"
 
 namespace merkle {
 
@@ -36,15 +37,93 @@ namespace merkle {
       bytes[i] = (n >> (8 * (sz - i - 1))) & 0xFF;
   }
 
+  /// @brief Loads a big-endian 64-bit word
+  static inline uint64_t load_be64(const uint8_t* bytes)
+  {
+    uint64_t w;
+    memcpy(&w, bytes, sizeof(w));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    return w;
+  }
+
+  /// @brief Stores a big-endian 64-bit word
+  static inline void store_be64(uint64_t w, uint8_t* bytes)
+  {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    memcpy(bytes, &w, sizeof(w));
+  }
 
 
+
+  /// @brief Nibble values of hex digits, 0xFF for anything else
+  struct HexTable
+  {
+    constexpr HexTable() : values()
+    {
+      for (int c = 0; c < 256; c++)
+        values[c] = 0xFF;
+      for (int c = 0; c < 10; c++)
+        values['0' + c] = c;
+      for (int c = 0; c < 6; c++)
+      {
+        values['a' + c] = 10 + c;
+        values['A' + c] = 10 + c;
+      }
+    }
+
+    uint8_t values[256];
+  };
+
+  static constexpr HexTable hex_table;
+
+  /// @brief Decodes hex digits into bytes
+  /// @param s Hex digits, two per byte
+  /// @param n Number of bytes to decode
+  /// @param out Buffer receiving @p n bytes
+  /// @return false if any of the 2 * @p n characters is not a hex digit
+  static inline bool hex_decode(const char* s, size_t n, uint8_t* out)
+  {
+    // Invalid digits set the high nibble, checked once at the end
+    uint8_t invalid = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+      uint8_t hi = hex_table.values[static_cast<uint8_t>(s[2 * i])];
+      uint8_t lo = hex_table.values[static_cast<uint8_t>(s[2 * i + 1])];
+      invalid |= hi | lo;
+      out[i] = (hi << 4) | (lo & 0x0F);
+    }
+    return (invalid & 0xF0) == 0;
+  }
+
+  /// @brief Encodes bytes as hex digits
+  /// @param bytes Bytes to encode
+  /// @param n Number of bytes
+  /// @param out Buffer receiving 2 * @p n characters
+  /// @param lower_case Enables lower-case hex characters
+  static inline void hex_encode(const uint8_t* bytes, size_t n, char* out, bool lower_case = true)
+  {
+    const char* digits = lower_case ? "0123456789abcdef" : "0123456789ABCDEF";
+    for (size_t i = 0; i < n; i++)
+    {
+      out[2 * i] = digits[bytes[i] >> 4];
+      out[2 * i + 1] = digits[bytes[i] & 0x0F];
+    }
+  }
+
   /// @brief Template for fixed-size hashes
   /// @tparam SIZE Size of the hash in number of bytes
   template <size_t SIZE>
   struct HashT
   {
-    /// Holds the hash bytes
-    uint8_t bytes[SIZE];
+    /// @brief Number of 64-bit limbs the hash is processed in
+    static constexpr size_t WORDS = SIZE / sizeof(uint64_t);
+
+    /// Holds the hash bytes, aligned for word-wise access
+    alignas(SIZE % sizeof(uint64_t) == 0 ? sizeof(uint64_t) : 1) uint8_t bytes[SIZE];
 
     /// @brief Constructs a Hash with all bytes set to zero
     HashT<SIZE>()
@@ -63,14 +142,8 @@ namespace merkle {
     /// @param s String to read the hash value from
     HashT<SIZE>(const std::string& s)
     {
-      if (s.length() != 2 * SIZE)
+      if (s.length() != 2 * SIZE || !hex_decode(s.data(), SIZE, bytes))
         throw std::runtime_error("invalid hash string");
-      for (size_t i = 0; i < SIZE; i++)
-      {
-        int tmp;
-        sscanf(s.c_str() + 2 * i, "%02x", &tmp);
-        bytes[i] = tmp;
-      }
     }
 
     /// @brief Deserialises a Hash from a vector of bytes
@@ -121,11 +194,21 @@ namespace merkle {
       return SIZE;
     }
 
-    uint64_t to_uint64() {
+    /// @brief The most significant 64 bits of the hash as a big-endian number
+    uint64_t to_uint64() const
+    {
       uint64_t res = 0;
-      for (size_t i = 0; i < SIZE; i++) {
-        res += bytes[i];
-      }
+      for (size_t i = 0; i < SIZE && i < sizeof(uint64_t); i++)
+        res |= static_cast<uint64_t>(bytes[i]) << (8 * (sizeof(uint64_t) - i - 1));
+      return res;
+    }
+
+    /// @brief The hash as a big-endian number, rounded to a double
+    double to_double() const
+    {
+      double res = 0;
+      for (size_t i = 0; i < SIZE; i++)
+        res = res * 256.0 + bytes[i];
       return res;
     }
 
@@ -134,24 +217,72 @@ namespace merkle {
     /// @param lower_case Enables lower-case hex characters
     std::string to_string(size_t num_bytes = SIZE, bool lower_case = true) const
     {
-      size_t num_chars = 2 * num_bytes;
-      std::string r(num_chars, '_');
-      for (size_t i = 0; i < num_bytes; i++)
-        snprintf(
-          const_cast<char*>(r.data() + 2 * i),
-          num_chars + 1 - 2 * i,
-          lower_case ? "%02x" : "%02X",
-          bytes[i]);
+      num_bytes = std::min(num_bytes, SIZE);
+      std::string r(2 * num_bytes, '_');
+      hex_encode(bytes, num_bytes, r.data(), lower_case);
       return r;
     }
 
     /// @brief Hash assignment operator
-    HashT<SIZE> operator=(const HashT<SIZE>& other)
+    HashT<SIZE>& operator=(const HashT<SIZE>& other)
     {
-      std::copy(other.bytes, other.bytes + SIZE, bytes);
+      memcpy(bytes, other.bytes, SIZE);
       return *this;
     }
 
+    /// @brief XORs another hash into this one
+    HashT<SIZE>& operator^=(const HashT<SIZE>& other)
+    {
+      if constexpr (SIZE % sizeof(uint64_t) == 0)
+      {
+        uint64_t a[WORDS], b[WORDS];
+        memcpy(a, bytes, SIZE);
+        memcpy(b, other.bytes, SIZE);
+        for (size_t i = 0; i < WORDS; i++)
+          a[i] ^= b[i];
+        memcpy(bytes, a, SIZE);
+      }
+      else
+      {
+        for (size_t i = 0; i < SIZE; i++)
+          bytes[i] ^= other.bytes[i];
+      }
+      return *this;
+    }
+
+    /// @brief Hash XOR operator
+    HashT<SIZE> operator^(const HashT<SIZE>& other) const
+    {
+      HashT<SIZE> res(*this);
+      res ^= other;
+      return res;
+    }
+
+    /// @brief Compares two hashes as big-endian numbers
+    /// @return -1, 0 or 1 if this hash is smaller, equal or bigger
+    int compare(const HashT<SIZE>& other) const
+    {
+      if constexpr (SIZE % sizeof(uint64_t) == 0)
+      {
+        // Scan from the least significant limb so every limb is visited
+        // and the most significant difference wins without branching
+        int res = 0;
+        for (size_t i = WORDS; i-- > 0;)
+        {
+          uint64_t a = load_be64(bytes + i * sizeof(uint64_t));
+          uint64_t b = load_be64(other.bytes + i * sizeof(uint64_t));
+          int c = (a > b) - (a < b);
+          res = c + (res & -(c == 0));
+        }
+        return res;
+      }
+      else
+      {
+        int c = memcmp(bytes, other.bytes, SIZE);
+        return (c > 0) - (c < 0);
+      }
+    }
+
     /// @brief Hash equality operator
     bool operator==(const HashT<SIZE>& other) const
     {
@@ -167,40 +298,67 @@ namespace merkle {
     /// @brief Hash less operator
     bool operator<(const HashT<SIZE>& other) const
     {
-      return memcmp(bytes, other.bytes, SIZE) < 0;
+      return compare(other) < 0;
     }
 
     /// @brief Hash less or equal operator
     bool operator<=(const HashT<SIZE>& other) const
     {
-      return memcmp(bytes, other.bytes, SIZE) <= 0;
+      return compare(other) <= 0;
     }
 
-    /// @brief Hash modulus operator
-    int operator%(int n) const
+    /// @brief Hash modulus operator, over the least significant 64 bits
+    /// so every index below @p n can come out for @p n up to 2^64
+    uint64_t operator%(uint64_t n) const
     {
-      return bytes[SIZE-1] % n;
+      if constexpr (SIZE >= sizeof(uint64_t))
+      {
+        return load_be64(bytes + SIZE - sizeof(uint64_t)) % n;
+      }
+      else
+      {
+        uint64_t res = 0;
+        for (size_t i = 0; i < SIZE; i++)
+          res = (res << 8) | bytes[i];
+        return res % n;
+      }
     }
 
     /// @brief Hash subtraction operator assumes that current hash is bigger than other
     HashT<SIZE> operator-(const HashT<SIZE>& other) const
     {
-      uint8_t res[SIZE];
-      int diff;
-      int borrow = 0;
+      HashT<SIZE> res;
 
-      for (size_t i = SIZE - 1; i <= 0; i--) {
-        diff = bytes[i] - other.bytes[i] - borrow;
-        if(diff < 0) {
-          diff += 256;
-          borrow = 1;
+      if constexpr (SIZE % sizeof(uint64_t) == 0)
+      {
+        uint64_t borrow = 0;
+        for (size_t i = WORDS; i-- > 0;)
+        {
+          uint64_t a = load_be64(bytes + i * sizeof(uint64_t));
+          uint64_t b = load_be64(other.bytes + i * sizeof(uint64_t));
+          uint64_t diff = a - b - borrow;
+          borrow = (a < b) | ((a == b) & borrow);
+          store_be64(diff, res.bytes + i * sizeof(uint64_t));
         }
-        else {
-          borrow = 0;
+      }
+      else
+      {
+        int borrow = 0;
+        for (size_t i = SIZE; i-- > 0;)
+        {
+          int diff = bytes[i] - other.bytes[i] - borrow;
+          borrow = diff < 0;
+          res.bytes[i] = diff + 256 * borrow;
         }
       }
 
-      return HashT<SIZE>(res);
+      return res;
+    }
+
+    /// @brief Absolute difference between two hashes as big-endian numbers
+    HashT<SIZE> distance(const HashT<SIZE>& other) const
+    {
+      return *this < other ? other - *this : *this - other;
     }
 
     /// @brief Serialises a hash
@@ -239,34 +397,176 @@ namespace merkle {
     }
   };
 
+  /// @brief Orders in which the nodes of a tree are serialized
+  enum class Layout
+  {
+    /// Level by level from the leaves, the order of TreeT::nodes
+    level,
+    /// Subtrees of a few levels packed into aligned blocks, so a path from
+    /// leaf to root reads one block per band of levels
+    blocked
+  };
+
+  /// @brief Maps tree nodes to their byte position in a serialized tree
+  /// @tparam HASH_SIZE Size of each hash in number of bytes
+  /// @tparam FANOUT The fanout value of the Merkle Tree
+  /// @tparam LEAVES The number of leaves of the Merkle Tree
+  template <size_t HASH_SIZE, size_t FANOUT, size_t LEAVES>
+  struct LayoutT
+  {
+    /// @brief Size of the header holding the file offset
+    static constexpr size_t HEADER = sizeof(uint64_t);
+
+    /// @brief Constructs the position map of a layout
+    /// @param layout Node order
+    /// @param block_size Size of the blocks used by Layout::blocked
+    LayoutT(Layout layout = Layout::level, size_t block_size = 4096) :
+      layout(layout),
+      block_size(block_size)
+    {
+      for (size_t n = LEAVES; n > 1; n /= FANOUT)
+        depth++;
+      if (layout == Layout::blocked && nodes_below(1) * HASH_SIZE > block_size)
+        throw std::runtime_error("block size too small for the fanout");
+      while (height < depth && nodes_below(height + 1) * HASH_SIZE <= block_size)
+        height++;
+      top = depth % height;
+      if (top == 0 && HEADER + (nodes_below(height) + 1) * HASH_SIZE <= block_size)
+        top = height;
+    }
+
+    /// @brief Byte position of a node in the serialized tree
+    /// @param index Index of the node in TreeT::nodes
+    size_t position(size_t index) const
+    {
+      if (layout == Layout::level)
+        return HEADER + index * HASH_SIZE;
+
+      // Depth from the root and position within that depth
+      size_t width = LEAVES;
+      size_t level = 0;
+      while (index >= width)
+      {
+        index -= width;
+        width /= FANOUT;
+        level++;
+      }
+      size_t d = depth - level;
+
+      // The first block holds the header and the levels above the first full band
+      if (d <= top)
+        return HEADER + ((power(d) - 1) / (FANOUT - 1) + index) * HASH_SIZE;
+
+      size_t band = (d - 1 - top) / height;
+      size_t t = d - top - band * height;
+      size_t block = index / power(t);
+      for (size_t b = 0; b < band; b++)
+        block += power(top + b * height);
+      return block_size * (1 + block) +
+        (nodes_below(t - 1) + index % power(t)) * HASH_SIZE;
+    }
+
+    /// @brief Size of a serialized tree in bytes
+    size_t size() const
+    {
+      if (layout == Layout::level)
+        return HEADER + (FANOUT * LEAVES - 1) / (FANOUT - 1) * HASH_SIZE;
+
+      size_t blocks = 0;
+      for (size_t b = 0; top + b * height < depth; b++)
+        blocks += power(top + b * height);
+      return block_size * (1 + blocks);
+    }
+
+    Layout layout;
+    size_t block_size;
+
+    /// @brief Number of levels above the leaves
+    size_t depth = 0;
+    /// @brief Number of levels in each block below the first one
+    size_t height = 1;
+    /// @brief Depth of the deepest level in the first block
+    size_t top = 0;
+
+  private:
+    static size_t power(size_t e)
+    {
+      size_t r = 1;
+      while (e-- > 0)
+        r *= FANOUT;
+      return r;
+    }
+
+    /// @brief Number of descendants of a node down to @p h levels below it
+    static size_t nodes_below(size_t h)
+    {
+      return (power(h + 1) - 1) / (FANOUT - 1) - 1;
+    }
+  };
+
   /// @brief Template for Merkle trees
   /// @tparam HASH_SIZE Size of each hash in number of bytes
   /// @tparam HASH_FUNCTION The hash function
+  /// @tparam ALLOCATOR Allocator of the node buffer
   template <
     size_t HASH_SIZE,
     void HASH_FUNCTION(
-      const std::vector<HashT<HASH_SIZE>>& values,
-      size_t start,
+      const HashT<HASH_SIZE>* values,
       size_t len,
       HashT<HASH_SIZE>& out),
     size_t FANOUT,
-    size_t LEAVES>
+    size_t LEAVES,
+    class ALLOCATOR = std::allocator<HashT<HASH_SIZE>>>
   class TreeT {
     public:
     /// @brief Constructs an empty tree
     TreeT() {}
 
+    /// @brief Constructs an empty tree whose nodes come from @p allocator
+    TreeT(const ALLOCATOR& allocator) : nodes(allocator) {}
+
     /// @brief Constructs a tree from vector of bytes
     TreeT(const std::vector<uint8_t> &bytes, uint64_t offset) {
+      if (bytes.size() < LEAVES * HASH_SIZE)
+        throw std::runtime_error("not enough bytes");
+
+      begin(offset);
+      for (size_t i = 0; i < LEAVES; i++)
+        push(HashT<HASH_SIZE>(bytes.data() + i * HASH_SIZE));
+    }
+
+    /// @brief Starts building a tree leaf by leaf
+    /// @param offset Offset of the chunk the leaves come from
+    ///
+    /// The node buffer is sized once for the whole tree and reused when the
+    /// same tree object builds the next chunk.
+    void begin(uint64_t offset) {
       file_offset = offset;
-      std::vector<HashT<HASH_SIZE>> values;
-      for (size_t i = 0; i < LEAVES; i++) {
-        size_t position = i * HASH_SIZE;
-        HashT<HASH_SIZE> hash(bytes, position);
-        values.push_back(hash);
-      }
+      leaves = 0;
+      nodes.resize((FANOUT * LEAVES - 1) / (FANOUT - 1));
+    }
 
-      build(values);
+    /// @brief Appends the next leaf and hashes every group of siblings it completes
+    /// @param leaf The leaf value
+    ///
+    /// Sibling groups are hashed in place from the node buffer, which holds
+    /// the whole tree since encoding and serializing need every node.
+    void push(const HashT<HASH_SIZE>& leaf) {
+      if (leaves == LEAVES)
+        throw std::runtime_error("Cannot push more leaves than the tree holds");
+
+      size_t index = leaves++;
+      size_t base = 0;
+      size_t width = LEAVES;
+      nodes[index] = leaf;
+      // The last node of a group completes its parent, which may be the last of its own group
+      while (width > 1 && index % FANOUT == FANOUT - 1) {
+        size_t first = base + index - (FANOUT - 1);
+        base += width;
+        width /= FANOUT;
+        index /= FANOUT;
+        HASH_FUNCTION(nodes.data() + first, FANOUT, nodes[base + index]);
+      }
     }
 
     void compute_leaves() {
@@ -282,12 +582,13 @@ namespace merkle {
         throw std::runtime_error("Cannot build a Merkle Tree with an empty vector");
       }
 
-      nodes = values;
       int total = (FANOUT * LEAVES - 1) / (FANOUT - 1);
+      nodes.reserve(total);
+      nodes.assign(values.begin(), values.end());
 
       for (size_t i = 0; i < total - LEAVES; i++) {
         HashT<HASH_SIZE> hash;
-        sha256(nodes, i*FANOUT, FANOUT, hash);
+        HASH_FUNCTION(nodes.data() + i * FANOUT, FANOUT, hash);
         nodes.push_back(hash);
       }
     }
@@ -303,27 +604,97 @@ namespace merkle {
       fi.close();
       
       std::ofstream f(filename, std::ofstream::binary);
-        std::vector<uint8_t> bytes;
-        serialise_uint64_t(file_offset, bytes);
-        for(HashT<HASH_SIZE> h: nodes) {
-          h.serialise(bytes);
-        }
-        for (char b : bytes)
-          f.write(&b, 1);
+        uint8_t header[sizeof(uint64_t)];
+        serialise_uint64_t(file_offset, header);
+        f.write(reinterpret_cast<const char*>(header), sizeof(header));
+        for (const HashT<HASH_SIZE>& h : nodes)
+          f.write(reinterpret_cast<const char*>(h.bytes), HASH_SIZE);
         f.close();
     }
 
+    /// @brief Serializes the tree with the given node layout
+    /// @param filename File to write, must not exist yet
+    /// @param layout Position map of the nodes
+    void serialize(std::string filename, const LayoutT<HASH_SIZE, FANOUT, LEAVES>& layout) {
+      if (layout.layout == Layout::level) {
+        serialize(filename);
+        return;
+      }
+
+      std::ifstream fi(filename, std::ifstream::binary);
+      if (fi.good())
+        throw std::runtime_error("Cannot serialize with given filename");
+      fi.close();
+
+      std::vector<uint8_t> bytes;
+      serialise(bytes, layout);
+      std::ofstream f(filename, std::ofstream::binary);
+      f.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+      f.close();
+    }
+
+    /// @brief Serializes the leaves followed by the top nodes of the tree
+    /// @param filename File to write, must not exist yet
+    /// @param leaves Leaf level to store in place of the full tree
+    /// @param top_nodes Number of nodes (counting back from the root) to store
+    template <class Leaves>
+    void serialize(std::string filename, const Leaves& leaves, size_t top_nodes) {
+      std::ifstream fi(filename, std::ifstream::binary);
+      if (fi.good())
+        throw std::runtime_error("Cannot serialize with given filename");
+      fi.close();
+
+      std::vector<uint8_t> bytes;
+      serialise(bytes, leaves, top_nodes);
+      std::ofstream f(filename, std::ofstream::binary);
+      f.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+      f.close();
+    }
+
+    /// @brief Writes the file contents serialize() would write to @p bytes
+    /// @param bytes Resized to the file size; reusing it across trees saves an allocation per tree
+    /// @param layout Position map of the nodes
+    void serialise(std::vector<uint8_t>& bytes, const LayoutT<HASH_SIZE, FANOUT, LEAVES>& layout) const {
+      bytes.resize(layout.size());
+      // Blocks are padded with zeros
+      if (layout.layout != Layout::level)
+        std::fill(bytes.begin(), bytes.end(), 0);
+      serialise_uint64_t(file_offset, bytes.data());
+      for (size_t i = 0; i < nodes.size(); i++)
+        std::copy(nodes[i].bytes, nodes[i].bytes + HASH_SIZE, bytes.data() + layout.position(i));
+    }
+
+    /// @brief Writes the leaves followed by the top nodes of the tree to @p bytes
+    /// @param bytes Resized to the file size, see serialise(bytes, layout)
+    /// @param leaves Leaf level to store in place of the full tree
+    /// @param top_nodes Number of nodes (counting back from the root) to store
+    template <class Leaves>
+    void serialise(std::vector<uint8_t>& bytes, const Leaves& leaves, size_t top_nodes) const {
+      if (top_nodes > nodes.size())
+        throw std::runtime_error("Cannot serialize more nodes than the tree holds");
+
+      bytes.resize(sizeof(uint64_t) + (leaves.size() + top_nodes) * HASH_SIZE);
+      serialise_uint64_t(file_offset, bytes.data());
+      uint8_t* out = bytes.data() + sizeof(uint64_t);
+      for (const HashT<HASH_SIZE>& h : leaves)
+        out = std::copy(h.bytes, h.bytes + HASH_SIZE, out);
+      for (size_t i = nodes.size() - top_nodes; i < nodes.size(); i++)
+        out = std::copy(nodes[i].bytes, nodes[i].bytes + HASH_SIZE, out);
+    }
+
     /// @brief Vector of nodes current in the tree
-    std::vector<HashT<HASH_SIZE>> nodes;
+    std::vector<HashT<HASH_SIZE>, ALLOCATOR> nodes;
     uint64_t file_offset;
+
+    private:
+    /// @brief Leaves pushed since begin()
+    size_t leaves = 0;
   };
 
-  static inline void sha256(const std::vector<HashT<32>>& values, size_t start, size_t len, HashT<32>& out) {
-    uint8_t block[32 * len];
-    for (size_t i = 0; i < len; i++) {
-      memcpy(&block[i * 32], values.at(start + i).bytes, 32);
-    }
-    SHA256(block, sizeof(block), out.bytes);
+  /// @brief Hashes @p len consecutive hashes, read in place
+  static inline void sha256(const HashT<32>* values, size_t len, HashT<32>& out) {
+    static_assert(sizeof(HashT<32>) == 32, "hashes must be contiguous bytes");
+    SHA256(values->bytes, 32 * len, out.bytes);
   }
 
   //   static inline void sha256_compress(const std::vector<HashT<32>>& values, size_t start, size_t len, HashT<32> &out) {
@@ -23,14 +23,22 @@ bool verify(std::string proof, std::string challenge) {
 }
 
 int main(int argc, char** argv) {
-  if (argc < 1) {
+  if (argc < 2) {
     std::cout << "Please enter a file name to plot.\n";
     return 0;
   }
     por::PoRepT<32, merkle::sha256, 2, 64> p;
 
+    // POR_TRACE=<file> writes a Chrome trace of the run
+    const char* trace_file = getenv("POR_TRACE");
+    if (trace_file != nullptr)
+        por::Tracer::instance().start();
+
     std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
-    p.plot(argv[1]);
+    if (argc > 2)
+        p.plot(std::vector<std::string>(argv + 1, argv + argc));
+    else
+        p.plot(argv[1]);
     std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
 
     std::cout << "Conflicts: " << p.get_conflicts() << std::endl;
@@ -53,6 +61,9 @@ int main(int argc, char** argv) {
     std::cout << v << std::endl;
     std::cout << pr << std::endl;
 
+    if (trace_file != nullptr)
+        por::Tracer::instance().dump(trace_file);
+
     // std::cout << proof.quality(c) << std::endl;
 
 }
\ No newline at end of file
@@ -1,4 +1,8 @@
 #include "merkle.hpp"
+#include "index.hpp"
+#include "durable.hpp"
+#include "cipher.hpp"
+#include "trace.hpp"
 #include "sloth256_189.h"
 #include <filesystem>
 #include <fstream>
@@ -7,15 +11,226 @@
 #include <algorithm>
 #include <map>
 #include <unistd.h>
+#include <sstream>
+#include <mutex>
+#include <thread>
 
 namespace fs = std::filesystem;
 
 namespace por {
-    int logb(int n, int b)
+    /// @brief Integer logarithm, exact for powers of @p b
+    constexpr size_t ilog(size_t n, size_t b)
     {
-    return log(n) / log(b);
+        return n < b ? 0 : 1 + ilog(n / b, b);
     }
 
+    /// @brief Logarithm of the exact power @p n of @p b
+    inline int logb(int n, int b)
+    {
+        return ilog(n, b);
+    }
+
+    /// @brief Integer power
+    constexpr size_t ipow(size_t b, size_t e)
+    {
+        return e == 0 ? 1 : b * ipow(b, e - 1);
+    }
+
+    /// @brief Deployment settings for how plotted trees are stored
+    struct PlotConfig {
+        /// @brief Directory holding one file per plotted tree
+        std::string plot_dir = "plot";
+
+        /// @brief Store the raw leaves plus @p top_levels levels instead of the
+        /// full encoded tree. Missing nodes are rebuilt when proving.
+        bool leaves_only = false;
+
+        /// @brief Number of encoded top levels (counting the root) stored
+        /// next to the leaves when @p leaves_only is set
+        size_t top_levels = 0;
+
+        /// @brief Back large plotting buffers with transparent huge pages
+        bool huge_pages = false;
+
+        /// @brief Number of top levels (counting the root) of every plot kept
+        /// in memory so proofs only read the lower levels from disk
+        size_t cache_levels = 0;
+
+        /// @brief Memory budget in bytes for the cached nodes, 0 disables the cache
+        size_t cache_budget = 0;
+
+        /// @brief Node order of the plot files
+        ///
+        /// merkle::Layout::blocked reads fewer regions per proof but pads
+        /// every block: with 4096-byte blocks plot files are about 59% larger
+        /// at 4x1024 and 78% larger at 8x4096, a few percent at fanout 2.
+        merkle::Layout layout = merkle::Layout::level;
+
+        /// @brief Block size used by merkle::Layout::blocked, ideally the page size
+        size_t block_size = 4096;
+
+        /// @brief Number of new roots collected before they become visible to provers
+        size_t index_batch = 1024;
+
+        /// @brief Milliseconds after which new roots become visible to provers
+        /// even if @p index_batch has not been reached
+        size_t index_delay = 1000;
+
+        /// @brief Keep only 8-byte root prefixes in memory, with the full roots
+        /// in a mapped sidecar file under @p plot_dir
+        bool compact_index = false;
+
+        /// @brief Number of chunks between durable checkpoints of a plot run,
+        /// 0 disables checkpoints
+        size_t checkpoint_interval = 0;
+
+        /// @brief Record a fingerprint per chunk so inputs can be re-plotted incrementally
+        bool manifest = false;
+
+        /// @brief AES-256-CTR key used to encrypt the input while plotting,
+        /// empty to plot the input as is
+        std::vector<uint8_t> encryption_key;
+
+        /// @brief Initial counter block for @p encryption_key, required with a key
+        ///
+        /// Every plot call salts it with a random 64-bit value, so inputs
+        /// plotted with the same key and IV never share keystream. Plot calls
+        /// return the salt; for input files it is also kept in a .salt
+        /// sidecar in plot_dir and in the checkpoint and manifest.
+        std::vector<uint8_t> encryption_iv;
+
+        /// @brief Maximum number of plots packed into one segment by compact()
+        size_t segment_records = 1024;
+
+        /// @brief Bytes per second compact() may copy, 0 for no limit
+        size_t compaction_rate = 0;
+    };
+
+    /// @brief Progress of a plot run, used to resume it after an interruption
+    struct Checkpoint {
+        /// @brief Next chunk of the input to plot
+        uint64_t offset = 0;
+        uint64_t plots = 0;
+        uint64_t conflicts = 0;
+        /// @brief Size of the input file, to detect a different input
+        uint64_t input_size = 0;
+        /// @brief Bytes per chunk, to detect a different tree geometry
+        uint64_t chunk_size = 0;
+        /// @brief Salt of the encryption IV of the run, see PlotConfig::encryption_iv
+        uint64_t salt = 0;
+
+        std::string to_string() const {
+            std::ostringstream s;
+            s << offset << " " << plots << " " << conflicts << " " << input_size << " " << chunk_size << " " << salt << "\n";
+            return s.str();
+        }
+
+        /// @brief Reads a checkpoint file
+        /// @return false if there is no valid checkpoint at @p path
+        bool load(const std::string& path) {
+            std::ifstream f(path);
+            if (!(f >> offset >> plots >> conflicts >> input_size >> chunk_size))
+                return false;
+            // Checkpoints without a salt were written with the unsalted IV
+            if (!(f >> salt))
+                salt = 0;
+            return true;
+        }
+    };
+
+    /// @brief Fingerprint and root of every plotted chunk of an input file
+    /// @tparam Hash The type of the roots
+    template <class Hash>
+    struct ManifestT {
+        struct Chunk {
+            /// @brief SHA-256 of the chunk contents
+            merkle::HashT<32> fingerprint;
+            Hash root;
+        };
+
+        /// @brief Chunks in input order, indexed by file offset
+        std::vector<Chunk> chunks;
+
+        /// @brief Salt of the encryption IV the input was plotted with, 0 if none
+        uint64_t salt = 0;
+
+        std::string to_string() const {
+            std::string s;
+            s.reserve(chunks.size() * (2 * (32 + sizeof(Hash)) + 2) + 32);
+            if (salt != 0)
+                s += "salt " + std::to_string(salt) + "\n";
+            for (const Chunk& c : chunks)
+                s += c.fingerprint.to_string() + " " + c.root.to_string() + "\n";
+            return s;
+        }
+
+        /// @brief Reads a manifest file
+        /// @return false if there is no manifest at @p path
+        bool load(const std::string& path) {
+            std::ifstream f(path);
+            if (!f.good())
+                return false;
+
+            chunks.clear();
+            salt = 0;
+            std::string fingerprint, root;
+            if (f >> std::ws && f.peek() == 's' && !(f >> fingerprint >> salt))
+                return false;
+            while (f >> fingerprint >> root)
+                chunks.push_back(Chunk{merkle::HashT<32>(fingerprint), Hash(root)});
+            return true;
+        }
+    };
+
+    /// @brief Chunks handled by the running plot call, safe to poll from any thread
+    struct Progress {
+        std::atomic<uint64_t> done{0};
+        std::atomic<uint64_t> total{0};
+
+        void start(uint64_t total_chunks, uint64_t done_chunks = 0) {
+            total = total_chunks;
+            done = done_chunks;
+        }
+    };
+
+    /// @brief Findings of a plot store audit
+    struct AuditReport {
+        /// @brief Number of plot files whose nodes were recomputed
+        size_t checked = 0;
+        /// @brief Plot files that are torn or whose nodes do not match their name
+        std::vector<std::string> corrupt;
+        /// @brief Files that are neither plots nor sidecars, and plots the index does not know
+        std::vector<std::string> orphans;
+        /// @brief Indexed roots without a plot file
+        std::vector<std::string> missing;
+
+        bool clean() const {
+            return corrupt.empty() && orphans.empty() && missing.empty();
+        }
+    };
+
+    /// @brief Index changes made by a rescan
+    struct RescanReport {
+        /// @brief Plots that appeared since the last scan
+        size_t added = 0;
+        /// @brief Plots whose file went while another copy remains
+        size_t moved = 0;
+        /// @brief Plots whose file went, or whose segment record died
+        size_t dropped = 0;
+    };
+
+    /// @brief Work done by a compaction
+    struct CompactionReport {
+        /// @brief Live plots copied into new segments
+        size_t moved = 0;
+        /// @brief Segments written
+        size_t segments = 0;
+        /// @brief Plot files, segments and leftovers deleted
+        size_t deleted = 0;
+        /// @brief Disk space given back, in bytes
+        size_t reclaimed = 0;
+    };
+
     template<typename Set>
     auto closest_element(Set& set, const typename Set::value_type& value)-> decltype(set.begin())
     {
@@ -36,15 +251,20 @@ namespace por {
         /// @brief The type of hashes in the tree
         typedef merkle::HashT<HASH_SIZE> Hash;
 
-        size_t n = logb(LEAVES, FANOUT) * (FANOUT - 1) + 2;
+        /// @brief Number of hashes in a proof
+        static constexpr size_t n = ilog(LEAVES, FANOUT) * (FANOUT - 1) + 2;
         std::vector<Hash> hashes;
 
         ProofT() {}
 
         ProofT(const std::string& s) {
+            if (s.length() < n * HASH_SIZE * 2)
+                throw std::runtime_error("invalid proof string");
+
+            hashes.resize(n);
             for (size_t i = 0; i < n; i++) {
-                Hash h(s.substr(i * HASH_SIZE * 2, HASH_SIZE * 2));
-                hashes.push_back(h);
+                if (!merkle::hex_decode(s.data() + i * HASH_SIZE * 2, HASH_SIZE, hashes[i].bytes))
+                    throw std::runtime_error("invalid proof string");
             }
         }
 
@@ -58,14 +278,19 @@ namespace por {
             }
         }
 
-        ProofT(const std::vector<uint8_t>& bytes, const std::vector<int>& indexes) {
+        /// @brief Extracts a proof from a serialized tree
+        /// @param bytes Contents of the plot file
+        /// @param indexes Path indexes in the order of TreeT::nodes
+        /// @param layout Node layout the tree was serialized with
+        ProofT(const std::vector<uint8_t>& bytes, const std::vector<int>& indexes,
+               const merkle::LayoutT<HASH_SIZE, FANOUT, LEAVES>& layout = merkle::LayoutT<HASH_SIZE, FANOUT, LEAVES>()) {
             size_t position;
             size_t begin = 0;
             uint64_t offset = merkle::deserialise_uint64_t(bytes, begin);
             size_t i = 0;
             while (i < n)
             {
-                position = indexes.at(i) * HASH_SIZE + begin;
+                position = layout.position(indexes.at(i));
                 Hash h(bytes, position);
                 hashes.push_back(h);
                 i++;
@@ -82,37 +307,75 @@ namespace por {
             return hashes[i];
         }
 
-        double quality(Hash challenge) {
-            std::set<Hash> nodes;
-
-            for (size_t i = 0; i < hashes.size() - 1; i++) {
-                nodes.insert(hashes[i]);
+        /// @brief The non-root hash of the proof closest to @p challenge
+        ///
+        /// Ties go to the smaller hash, as with closest_element. The proof is
+        /// a short flat array, so a linear scan beats building a sorted set.
+        const Hash& closest_node(const Hash& challenge) const {
+            size_t best = 0;
+            Hash best_distance = hashes[0].distance(challenge);
+            for (size_t i = 1; i + 1 < hashes.size(); i++) {
+                Hash distance = hashes[i].distance(challenge);
+                int c = distance.compare(best_distance);
+                if (c < 0 || (c == 0 && hashes[i] < hashes[best])) {
+                    best = i;
+                    best_distance = distance;
+                }
             }
+            return hashes[best];
+        }
 
-            auto node = *closest_element(nodes, challenge);
+        /// @brief Relative distance between @p challenge and the proof, lower is better
+        double quality(const Hash& challenge) const {
+            const Hash& node = closest_node(challenge);
 
             Hash h;
+            memcpy(h.bytes, hashes[n - 1].bytes, HASH_SIZE / 2);
+            memcpy(h.bytes + HASH_SIZE / 2, node.bytes + HASH_SIZE / 2, HASH_SIZE - HASH_SIZE / 2);
 
-            for (size_t i = 0; i < HASH_SIZE/2; i++) {
-                h.bytes[i] = root().bytes[i];
-            }
+            Hash dif = h.distance(challenge);
+            return dif.to_double() / (challenge.to_double() + h.to_double());
+        }
+
+        /// @brief Scores many (proof, challenge) pairs
+        /// @param proofs The proofs
+        /// @param challenges The challenge of each proof
+        static std::vector<double> quality(const std::vector<ProofT>& proofs, const std::vector<Hash>& challenges) {
+            if (proofs.size() != challenges.size())
+                throw std::runtime_error("Every proof needs a challenge");
+
+            std::vector<double> scores(proofs.size());
+            for (size_t i = 0; i < proofs.size(); i++)
+                scores[i] = proofs[i].quality(challenges[i]);
+            return scores;
+        }
 
-            for (size_t i = HASH_SIZE/2; i < HASH_SIZE; i++) {
-                h.bytes[i] = node.bytes[i];
+        /// @brief Picks the proofs with the best quality for a challenge
+        /// @param proofs The candidate proofs
+        /// @param challenge The challenge of the round
+        /// @param k Maximum number of proofs to pick
+        /// @return Indexes into @p proofs, best first
+        static std::vector<size_t> best(const std::vector<ProofT>& proofs, const Hash& challenge, size_t k) {
+            std::vector<double> scores(proofs.size());
+            std::vector<size_t> order(proofs.size());
+            for (size_t i = 0; i < proofs.size(); i++) {
+                scores[i] = proofs[i].quality(challenge);
+                order[i] = i;
             }
 
-            Hash dif = h < challenge ? challenge - h : h - challenge;
-            return (double)dif.to_uint64() / (double)(challenge.to_uint64() + h.to_uint64());
+            k = std::min(k, proofs.size());
+            std::partial_sort(order.begin(), order.begin() + k, order.end(), [&](size_t a, size_t b) {
+                return scores[a] < scores[b] || (scores[a] == scores[b] && a < b);
+            });
+            order.resize(k);
+            return order;
         }
 
         std::string to_string() const {
-            std::string s;
+            std::string s(hashes.size() * HASH_SIZE * 2, '_');
 
-            for (size_t i = 0; i < hashes.size(); i++) {
-                std::string h =  hashes[i].to_string();
-                s = s + h;
-                std::cout << "hash string size: " << h.length() << std::endl;
-            }
+            for (size_t i = 0; i < hashes.size(); i++)
+                merkle::hex_encode(hashes[i].bytes, HASH_SIZE, s.data() + i * HASH_SIZE * 2);
 
             return s;
         }
@@ -127,8 +390,7 @@ namespace por {
     template <
     size_t HASH_SIZE,
     void HASH_FUNCTION(
-      const std::vector<merkle::HashT<HASH_SIZE>>& values,
-      size_t start,
+      const merkle::HashT<HASH_SIZE>* values,
       size_t len,
       merkle::HashT<HASH_SIZE>& out),
     size_t FANOUT,
@@ -139,22 +401,338 @@ namespace por {
             typedef merkle::HashT<HASH_SIZE> Hash;
             
             /// @brief The type of the tree
-            typedef merkle::TreeT<HASH_SIZE, HASH_FUNCTION, FANOUT, LEAVES> Tree;
+            typedef merkle::TreeT<HASH_SIZE, HASH_FUNCTION, FANOUT, LEAVES, merkle::PageAllocator<Hash>> Tree;
 
             /// @brief The type of the proof
             typedef ProofT<HASH_SIZE, FANOUT, LEAVES> Proof;
 
+            /// @brief The type of the node position map of plot files
+            typedef merkle::LayoutT<HASH_SIZE, FANOUT, LEAVES> NodeLayout;
+
+            /// @brief Number of levels above the leaves
+            static constexpr size_t DEPTH = ilog(LEAVES, FANOUT);
+
+            /// @brief Number of nodes in a tree
+            static constexpr size_t TOTAL = (FANOUT * LEAVES - 1) / (FANOUT - 1);
+
+            /// @brief Input bytes encoded into each tree
+            static constexpr size_t CHUNK_SIZE = LEAVES * HASH_SIZE;
+
+            /// @brief Cache slot of plots without cached nodes
+            static constexpr size_t NO_SLOT = SIZE_MAX;
+            static constexpr uint32_t NO_SEGMENT = UINT32_MAX;
+            /// @brief Line of a segment's .roots file standing for a dead record
+            static constexpr const char* DEAD_RECORD = "-";
+
+            /// @brief Data the root index keeps for every plot
+            struct Location {
+                /// @brief Slot in the top-level cache or NO_SLOT
+                size_t cache_slot = NO_SLOT;
+                /// @brief Segment holding the plot or NO_SEGMENT if it has its own file
+                uint32_t segment = NO_SEGMENT;
+                /// @brief Position of the plot within its segment
+                uint32_t record = 0;
+            };
+
+            /// @brief The type of the root index
+            typedef RootIndexT<Hash, Location> RootIndex;
+
+
+            /// @brief Buffers a plotting worker reuses across chunks
+            struct Workspace {
+                /// @param salt Salt of the encryption IV of the input, see PlotConfig::encryption_iv
+                Workspace(const PlotConfig& config, uint64_t salt = 0) :
+                    tree(merkle::PageAllocator<Hash>(config.huge_pages)),
+                    leaves(merkle::PageAllocator<Hash>(config.huge_pages)),
+                    chunk(LEAVES * HASH_SIZE, 0, merkle::PageAllocator<uint8_t>(config.huge_pages))
+                {
+                    if (!config.encryption_key.empty())
+                        cipher.reset(new ChunkCipher(config.encryption_key, ChunkCipher::salted_iv(config.encryption_iv, salt)));
+                }
 
-        PoRepT() {}
+                Tree tree;
+                std::vector<Hash, merkle::PageAllocator<Hash>> leaves;
+                /// @brief Bytes of the current chunk, encrypted if a key is set
+                std::vector<uint8_t, merkle::PageAllocator<uint8_t>> chunk;
+                std::unique_ptr<ChunkCipher> cipher;
+                /// @brief Contents of the plot file being written or audited
+                std::vector<uint8_t> file;
+                /// @brief Path of the plot file being written, see plot_filename()
+                std::string filename;
+                /// @brief Encoded nodes of the plot being audited
+                std::vector<Hash> encoded;
+            };
+
+            /// @brief The type of the per-input chunk manifest
+            typedef ManifestT<Hash> Manifest;
+
+
+        PoRepT() : PoRepT(PlotConfig()) {}
+
+        PoRepT(const PlotConfig& config) :
+            config(config),
+            layout(config.layout, config.block_size),
+            dependencies(dependency_table()),
+            search(config.index_batch, config.compact_index ? config.plot_dir : "", std::chrono::milliseconds(config.index_delay)) {
+            if (config.leaves_only && config.layout != merkle::Layout::level)
+                throw std::runtime_error("Leaves-only plots only support the level layout");
+            if (!config.encryption_key.empty() && config.encryption_iv.size() != ChunkCipher::BLOCK_SIZE)
+                throw std::runtime_error("An encryption key needs a 16-byte encryption_iv");
+
+            // The arena never grows, so readers can use published slots while plotting
+            size_t count = cached_top_nodes();
+            if (count > 0) {
+                cache_capacity = config.cache_budget / (count * HASH_SIZE);
+                cache.resize(cache_capacity * count);
+            }
+        }
 
         void load_plot(std::string path) {
             // std::string path = "./plot";
+            std::vector<typename RootIndex::Entry> found;
             for (const auto & entry : fs::directory_iterator(path)) {
-                Hash h(entry.path().filename());
-                search.insert(h);
+                std::string name = entry.path().filename();
+                uint32_t segment = 0;
+                if (parse_segment(name, ".roots", segment)) {
+                    read_segment(segment, found);
+                    continue;
+                }
+
+                // Skip checkpoints and anything else that is not named after a root
+                Hash h;
+                if (name.size() != 2 * HASH_SIZE || !merkle::hex_decode(name.data(), HASH_SIZE, h.bytes))
+                    continue;
+                found.push_back({h, Location()});
+            }
+            index_found(std::move(found));
+        }
+
+        /// @brief Indexes the plots of a committed segment
+        void load_segment(uint32_t segment) {
+            std::vector<typename RootIndex::Entry> found;
+            read_segment(segment, found);
+            index_found(std::move(found));
+        }
+
+        /// @brief Appends the live plots listed in the .roots file of @p segment to @p found
+        void read_segment(uint32_t segment, std::vector<typename RootIndex::Entry>& found) {
+            next_segment = std::max(next_segment, segment + 1);
+            std::string roots_file = segment_path(segment) + ".roots";
+            // Taken before reading, so a later change is picked up by rescan()
+            std::error_code ec;
+            segment_times[segment] = fs::last_write_time(roots_file, ec);
+            std::ifstream f(roots_file);
+            std::string root;
+            for (uint32_t record = 0; f >> root; record++) {
+                if (root == DEAD_RECORD)
+                    continue;
+                Location location;
+                location.segment = segment;
+                location.record = record;
+                found.push_back({Hash(root), location});
+            }
+        }
+
+        /// @brief Brings the index in line with plot_dir after load_plot() (writer only)
+        ///
+        /// Lists the directory but only reads what changed: plot files not
+        /// indexed yet, and the .roots of segments that are new or were
+        /// rewritten since they were read. Roots whose plot file or segment
+        /// is gone, or whose record was marked dead, are dropped, unless a
+        /// segment or a plot file holds a copy, as during a compaction by
+        /// another process; then they move there in the same publish. Proofs
+        /// can be generated meanwhile.
+        RescanReport rescan() {
+            typedef typename RootIndex::Entry Entry;
+            RescanReport report;
+
+            std::vector<Hash> files;
+            std::map<uint32_t, fs::file_time_type> segments;
+            for (const auto& entry : fs::directory_iterator(config.plot_dir)) {
+                std::string name = entry.path().filename();
+                uint32_t segment = 0;
+                Hash h;
+                std::error_code ec;
+                if (parse_segment(name, ".roots", segment))
+                    segments[segment] = fs::last_write_time(entry.path(), ec);
+                else if (name.size() == 2 * HASH_SIZE && merkle::hex_decode(name.data(), HASH_SIZE, h.bytes))
+                    files.push_back(h);
+            }
+            std::sort(files.begin(), files.end());
+
+            // Segments read again keep only the records still listed live
+            auto snapshot = search.snapshot();
+            std::vector<Entry> found;
+            std::set<std::pair<uint32_t, uint32_t>> live;
+            std::set<uint32_t> reread;
+            for (const auto& s : segments) {
+                auto known = segment_times.find(s.first);
+                if (known != segment_times.end() && known->second == s.second)
+                    continue;
+                reread.insert(s.first);
+                std::vector<Entry> listed;
+                read_segment(s.first, listed);
+                for (Entry& e : listed) {
+                    live.insert({e.value.segment, e.value.record});
+                    auto indexed = snapshot->find(e.root);
+                    if (indexed == nullptr)
+                        found.push_back(e);
+                    else if (indexed->value.segment != e.value.segment || indexed->value.record != e.value.record)
+                        shadowed[e.root] = e.value;
+                }
+            }
+            auto gone = [&](const Location& l) {
+                if (l.segment == NO_SEGMENT)
+                    return false;
+                return segments.count(l.segment) == 0 || (reread.count(l.segment) > 0 && live.count({l.segment, l.record}) == 0);
+            };
+            for (auto it = segment_times.begin(); it != segment_times.end();)
+                it = segments.count(it->first) > 0 ? std::next(it) : segment_times.erase(it);
+            for (auto it = shadowed.begin(); it != shadowed.end();)
+                it = gone(it->second) ? shadowed.erase(it) : std::next(it);
+
+            std::vector<size_t> slots;
+            for (const auto& entry : *snapshot) {
+                const Location& l = entry.value;
+                if (l.segment == NO_SEGMENT ? std::binary_search(files.begin(), files.end(), entry.root) : !gone(l))
+                    continue;
+                auto copy = shadowed.find(entry.root);
+                bool file = l.segment != NO_SEGMENT && std::binary_search(files.begin(), files.end(), entry.root);
+                if (copy != shadowed.end() || file) {
+                    // Same root, same nodes: the cached ones stay valid
+                    Location moved = file ? Location() : copy->second;
+                    moved.cache_slot = l.cache_slot;
+                    search.assign(entry.root, moved);
+                    if (copy != shadowed.end())
+                        shadowed.erase(copy);
+                    report.moved++;
+                }
+                else {
+                    search.erase(entry.root);
+                    slots.push_back(l.cache_slot);
+                    report.dropped++;
+                }
+            }
+            for (const Hash& h : files) {
+                if (snapshot->find(h) == nullptr)
+                    found.push_back({h, Location()});
+            }
+
+            // Moves and drops are published before the new roots are merged in
+            size_t before = search.size();
+            index_found(std::move(found));
+            report.added = search.size() - before;
+            if (!slots.empty()) {
+                RootIndex::wait_for_readers(snapshot);
+                release_slots(slots);
+            }
+            return report;
+        }
+
+        /// @brief Indexes and publishes plots found on disk, caching the top nodes of the new ones
+        ///
+        /// A crash during compaction can leave a plot in two places; the
+        /// first one found is kept.
+        void index_found(std::vector<typename RootIndex::Entry> found) {
+            search.bulk_insert(std::move(found), [this](typename RootIndex::Entry& e) {
+                e.value.cache_slot = load_cached_nodes(plot_path(e.root, e.value), plot_base(e.value));
+            });
+        }
+
+        /// @brief Data file of a segment, its roots are in the .roots sidecar
+        std::string segment_path(uint32_t segment) const {
+            char name[32];
+            snprintf(name, sizeof(name), "segment-%08x", segment);
+            return config.plot_dir + "/" + name;
+        }
+
+        /// @brief Parses the id out of a segment file name ending in @p suffix
+        static bool parse_segment(const std::string& name, const std::string& suffix, uint32_t& segment) {
+            const std::string prefix = "segment-";
+            if (name.size() != prefix.size() + 8 + suffix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+                name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+                return false;
+            uint8_t id[4];
+            if (!merkle::hex_decode(name.data() + prefix.size(), sizeof(id), id))
+                return false;
+            segment = uint32_t(id[0]) << 24 | uint32_t(id[1]) << 16 | uint32_t(id[2]) << 8 | id[3];
+            return true;
+        }
+
+        /// @brief File holding a plot
+        std::string plot_path(const Hash& root, const Location& location) const {
+            if (location.segment == NO_SEGMENT)
+                return config.plot_dir + "/" + root.to_string();
+            return segment_path(location.segment);
+        }
+
+        /// @brief Byte offset of a plot within its file
+        size_t plot_base(const Location& location) const {
+            return location.segment == NO_SEGMENT ? 0 : location.record * plot_file_size();
+        }
+
+        /// @brief Number of top nodes held in the cache for every plot
+        size_t cached_top_nodes() const {
+            if (config.leaves_only || config.cache_budget == 0)
+                return 0;
+            size_t levels = std::min(config.cache_levels, DEPTH + 1);
+            return (ipow(FANOUT, levels) - 1) / (FANOUT - 1);
+        }
+
+        /// @brief Copies the top nodes of a plot into the cache while the budget allows
+        /// @param top The last cached_top_nodes() nodes of the encoded tree
+        /// @return The cache slot or NO_SLOT
+        size_t cache_top_nodes(const Hash* top) {
+            size_t count = cached_top_nodes();
+            if (count == 0 || cache_full())
+                return NO_SLOT;
+            size_t slot;
+            if (free_slots.empty()) {
+                slot = cache_used++;
+            }
+            else {
+                slot = free_slots.back();
+                free_slots.pop_back();
+            }
+            std::copy(top, top + count, cache.begin() + slot * count);
+            return slot;
+        }
+
+        /// @brief Whether every cache slot holds a plot
+        bool cache_full() const {
+            return cache_used >= cache_capacity && free_slots.empty();
+        }
+
+        /// @brief Hands the cache slots of removed plots back for reuse
+        /// @param slots Slots of plots no published snapshot refers to any more
+        void release_slots(const std::vector<size_t>& slots) {
+            for (size_t slot : slots) {
+                if (slot != NO_SLOT)
+                    free_slots.push_back(slot);
             }
         }
 
+        /// @brief Reads the top nodes of a stored plot into the cache
+        /// @param file File holding the plot
+        /// @param base Byte offset of the plot within @p file
+        /// @return The cache slot or NO_SLOT
+        size_t load_cached_nodes(const fs::path& file, size_t base = 0) {
+            size_t count = cached_top_nodes();
+            if (count == 0 || cache_full())
+                return NO_SLOT;
+
+            std::vector<Hash> top(count);
+            std::ifstream f(file, std::ifstream::binary);
+            for (size_t i = 0; i < count; i++) {
+                f.seekg(base + layout.position(TOTAL - count + i));
+                f.read(reinterpret_cast<char*>(top[i].bytes), HASH_SIZE);
+            }
+            // Files torn by an interrupted run are proven from disk until replotted
+            if (!f.good())
+                return NO_SLOT;
+            return cache_top_nodes(top.data());
+        }
+
         // void encode(std::vector<Hash>& v) {
         //     std::vector<Hash> values;
         //     Hash res;
@@ -198,28 +776,47 @@ namespace por {
             sleep(0.03474049910109898);
         }
 
-        void encode(std::vector<Hash>& v) {
-            std::map<int, int> dep;
+        /// @brief Position in a proof of the first node of the level after position @p i
+        ///
+        /// Proofs hold the FANOUT leaves of the challenged group, then the
+        /// FANOUT - 1 siblings of the path on every level, then the root.
+        static size_t next_level(size_t i) {
+            if (i < FANOUT)
+                return FANOUT;
+            return FANOUT + ((i - FANOUT) / (FANOUT - 1) + 1) * (FANOUT - 1);
+        }
+
+        /// @brief Maps every node to the node its encoding is chained to
+        ///
+        /// A node is chained to the first proof node of the next level, which
+        /// every proof holding the node also holds whatever the challenged leaf.
+        static std::vector<int> get_dependencies() {
+            std::vector<int> dep(TOTAL, 0);
             for (int i = 0; i < LEAVES; i += FANOUT) {
                 std::vector<int> indexes = get_path_indexes(i);
-                int i0 = indexes[0];
-                int i1 = indexes[1];
-                dep[i0] = indexes[2];
-                dep[i1] = indexes[2];
-
-                for (int j = 2; j < indexes.size() - 1; j++) {
-                    dep[indexes[j]] = indexes[j + 1];
+                for (size_t j = 0; j < indexes.size() - 1; j++) {
+                    dep[indexes[j]] = indexes[next_level(j)];
                 }
             }
+            return dep;
+        }
+
+        /// @brief The get_dependencies() table, built on first use and shared
+        /// by every prover of this geometry
+        static const std::vector<int>& dependency_table() {
+            static const std::vector<int> table = get_dependencies();
+            return table;
+        }
+
+        template <class Nodes>
+        void encode(Nodes& v) {
+            const std::vector<int>& dep = dependencies;
 
             vde(v.back());
 
             for (int i = v.size() - 2; i >= 0; i--) {
                 int parentIndex = dep[i];
-                Hash parent = v[parentIndex];
-                for(uint8_t j = 0; j < HASH_SIZE; j++) {
-                    v[i].bytes[j] = v[i].bytes[j] ^ parent.bytes[j];
-                }
+                v[i] ^= v[parentIndex];
 
                 vde(v[i]);
             }
@@ -229,11 +826,8 @@ namespace por {
             Proof decoded;
 
             for (int i = 0; i < p.n - 1; i++) {
-                Hash parent = (i == 0 || i == 1) ? p.at(2) : p.at(i + 1);
-                Hash dec;
-                for(uint8_t j = 0; j < HASH_SIZE; j++) {
-                    dec.bytes[j] = p.at(i).bytes[j] ^ parent.bytes[j];
-                }
+                Hash parent = p.at(next_level(i));
+                Hash dec = p.at(i) ^ parent;
 
                 vdd(dec);
                 decoded.hashes.push_back(dec);
@@ -253,52 +847,810 @@ namespace por {
                 hi.bytes[HASH_SIZE-1] = indexes.at(i);
                 values.push_back(p.root());
                 values.push_back(hi);
-                HASH_FUNCTION(values, 0, 2, res);
-                for(uint8_t j = 0; j < HASH_SIZE; j++) {
-                    t.bytes[j] = p.at(i).bytes[j] ^ res.bytes[j];
-                }
+                HASH_FUNCTION(values.data(), 2, res);
+                t = p.at(i) ^ res;
                 decoded.hashes.push_back(t);
                 values.clear();
             }
             return decoded;
         }
 
-        void plot(char* filename) {
+        /// @brief Plots an input file
+        /// @return Salt of the encryption IV, also kept in the input's .salt
+        /// sidecar in plot_dir; 0 without encryption
+        uint64_t plot(char* filename) {
             std::ifstream f(filename, std::ifstream::binary);
             if (!f.good())
                 throw std::runtime_error("Cannot plot from invalid file");
+
+            // Continue after the last checkpoint of an interrupted run
+            Checkpoint checkpoint;
+            Manifest manifest;
+            std::string checkpoint_file = checkpoint_path(filename);
+            uint64_t input_size = fs::file_size(filename);
+            int base_plots = plots;
+            int base_conflicts = conflicts;
+            bool resuming = config.checkpoint_interval > 0 && checkpoint.load(checkpoint_file);
+            if (resuming) {
+                if (checkpoint.input_size != input_size || checkpoint.chunk_size != LEAVES * HASH_SIZE)
+                    throw std::runtime_error("Checkpoint does not match the input file");
+                if (search.size() == 0)
+                    load_plot(config.plot_dir);
+                plots += checkpoint.plots;
+                conflicts += checkpoint.conflicts;
+                f.seekg(checkpoint.offset * LEAVES * HASH_SIZE);
+                if (config.manifest && manifest.load(manifest_path(filename)))
+                    manifest.chunks.resize(checkpoint.offset);
+            }
+            else {
+                checkpoint.salt = new_salt();
+                save_salt(filename, checkpoint.salt);
+                if (config.checkpoint_interval > 0) {
+                    // A run killed before its first interval resumes from the start
+                    checkpoint.input_size = input_size;
+                    checkpoint.chunk_size = LEAVES * HASH_SIZE;
+                    save_checkpoint(checkpoint_file, checkpoint);
+                }
+            }
+            manifest.salt = checkpoint.salt;
         
-            std::vector<uint8_t> bytes;
-            char t;
-            int offset = 0;
-            while (!f.eof())
+            Workspace ws(config, checkpoint.salt);
+            uint64_t offset = resuming ? checkpoint.offset : 0;
+            progress.start(input_size / (LEAVES * HASH_SIZE), offset);
+            while (read_chunk(f, ws, offset))
             {
-                int n = LEAVES*HASH_SIZE;
-                while (!f.eof() && n-- > 0)
-                {
-                f.read(&t, 1);
-                bytes.push_back(t);
-                }
-                if(n < 0) {
-                    Tree tree(bytes, offset);
-                    encode(tree.nodes);
-                    if (search.insert(tree.root()).second == false) {
-                        conflicts++;
-                    }
-                    else {
-                        tree.serialize("plot/"+tree.root().to_string());
-                        plots++;
-                    }
+                build_chunk(ws, offset);
+                plot_chunk(ws, resuming);
+                search.maybe_publish();
+                if (config.manifest)
+                    manifest.chunks.push_back({fingerprint(ws), ws.tree.root()});
+                progress.done = ++offset;
+
+                if (config.checkpoint_interval > 0 && offset % config.checkpoint_interval == 0) {
+                    checkpoint.offset = offset;
+                    checkpoint.plots = plots - base_plots;
+                    checkpoint.conflicts = conflicts - base_conflicts;
+                    checkpoint.input_size = input_size;
+                    checkpoint.chunk_size = LEAVES * HASH_SIZE;
+                    if (config.manifest)
+                        write_atomically(manifest_path(filename), manifest.to_string());
+                    save_checkpoint(checkpoint_file, checkpoint);
                 }
-                bytes.clear();
-                offset++;
             }
             // std::cout << "conflicts: " << conflicts << std::endl;
             // std::cout << "plots: " << plots << std::endl;
             f.close();
+            search.publish();
+
+            if (config.manifest) {
+                sync_plots();
+                write_atomically(manifest_path(filename), manifest.to_string());
+            }
+            if (config.checkpoint_interval > 0) {
+                sync_plots();
+                fs::remove(checkpoint_file);
+            }
+            return checkpoint.salt;
+        }
+
+        /// @brief Plots an input held in memory
+        /// @param data The input, its chunks are encrypted on the fly if a key is set
+        /// @param size Size of @p data in bytes, a trailing partial chunk is ignored
+        /// @return Salt of the encryption IV, 0 without encryption; nothing
+        /// else records it, so keep it to decrypt or re-plot the input
+        uint64_t plot(const uint8_t* data, size_t size) {
+            const uint64_t salt = new_salt();
+            Workspace ws(config, salt);
+            const size_t chunks = size / ws.chunk.size();
+            progress.start(chunks);
+            for (uint64_t offset = 0; offset < chunks; offset++) {
+                std::copy_n(data + offset * ws.chunk.size(), ws.chunk.size(), ws.chunk.begin());
+                if (ws.cipher)
+                    ws.cipher->apply(ws.chunk.data(), ws.chunk.size(), offset * ws.chunk.size());
+                build_chunk(ws, offset);
+                plot_chunk(ws);
+                search.maybe_publish();
+                progress.done = offset + 1;
+            }
+            search.publish();
+            return salt;
         }
 
-        std::vector<int> get_path_indexes(int index) {
+        /// @brief Plots several inputs at once with a shared pool of workers
+        /// @param filenames The inputs
+        /// @param threads Number of workers, 0 uses one per core
+        ///
+        /// Chunks of all inputs are handed out one by one, so small inputs do
+        /// not leave workers idle. Chunk k of input i gets the offset
+        /// k + (chunks of inputs 0..i-1), unique across the inputs, and the
+        /// encryption counter follows that offset too, under a salt drawn for
+        /// the call, so no two inputs share keystream. Workers encode and store in parallel; indexing goes
+        /// through one mutex-guarded writer. Checkpoints and manifests are
+        /// per input and not supported here.
+        /// @return Salt of the encryption IV, also kept in the .salt sidecar
+        /// of every input; 0 without encryption
+        uint64_t plot(const std::vector<std::string>& filenames, size_t threads = 0) {
+            if (config.checkpoint_interval > 0 || config.manifest)
+                throw std::runtime_error("Multi-input plotting does not support checkpoints or manifests");
+
+            const size_t chunk_size = LEAVES * HASH_SIZE;
+            std::vector<uint64_t> first(1, 0);
+            for (const std::string& filename : filenames) {
+                if (!fs::is_regular_file(filename))
+                    throw std::runtime_error("Cannot plot from invalid file " + filename);
+                first.push_back(first.back() + fs::file_size(filename) / chunk_size);
+            }
+
+            if (threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            progress.start(first.back());
+            const uint64_t salt = new_salt();
+            for (const std::string& filename : filenames)
+                save_salt(filename, salt);
+            std::atomic<uint64_t> next(0);
+            std::mutex writer;
+            std::set<Hash> claimed;
+            std::exception_ptr error;
+            std::vector<std::thread> workers;
+            for (size_t t = 0; t < std::min<uint64_t>(threads, first.back()); t++) {
+                workers.emplace_back([&]() {
+                    Workspace ws(config, salt);
+                    std::ifstream f;
+                    size_t input = filenames.size();
+                    try {
+                        for (uint64_t offset = next++; offset < first.back(); offset = next++) {
+                            size_t i = std::upper_bound(first.begin(), first.end(), offset) - first.begin() - 1;
+                            if (i != input) {
+                                f.close();
+                                f.clear();
+                                f.open(filenames[i], std::ifstream::binary);
+                                input = i;
+                            }
+                            f.seekg((offset - first[i]) * chunk_size);
+                            if (!read_chunk(f, ws, offset))
+                                throw std::runtime_error("Cannot read " + filenames[i]);
+                            build_chunk(ws, offset);
+                            plot_chunk(ws, writer, claimed);
+                            progress.done++;
+                        }
+                    }
+                    catch (...) {
+                        std::lock_guard<std::mutex> lock(writer);
+                        if (!error)
+                            error = std::current_exception();
+                        next = first.back();
+                    }
+                });
+            }
+            for (auto& w : workers)
+                w.join();
+            search.publish();
+            if (error)
+                std::rethrow_exception(error);
+            return salt;
+        }
+
+        /// @brief Re-plots only the chunks of an input that changed since its last plot
+        /// @param filename Input plotted before with PlotConfig::manifest set
+        ///
+        /// Changed chunks are re-encoded and stored, then the index swaps the
+        /// new roots in and the stale ones out in a single publish. A stale
+        /// root stays if the input still holds the chunk elsewhere or the
+        /// manifest of another input in plot_dir lists it; inputs that share
+        /// chunks with a replotted one need manifests too. Stale files and
+        /// cache slots are freed once no prover uses the old index any more.
+        void replot(char* filename) {
+            Manifest previous;
+            std::string manifest_file = manifest_path(filename);
+            if (!previous.load(manifest_file))
+                throw std::runtime_error("No manifest to replot from, plot with PlotConfig::manifest first");
+
+            std::ifstream f(filename, std::ifstream::binary);
+            if (!f.good())
+                throw std::runtime_error("Cannot plot from invalid file");
+            if (search.size() == 0)
+                load_plot(config.plot_dir);
+
+            // Unchanged chunks only match their fingerprints under the same keystream
+            Manifest current;
+            current.salt = previous.salt;
+            std::vector<Hash> stale;
+            Workspace ws(config, current.salt);
+            uint64_t offset = 0;
+            progress.start(fs::file_size(filename) / ws.chunk.size());
+            while (read_chunk(f, ws, offset))
+            {
+                merkle::HashT<32> print = fingerprint(ws);
+                if (offset < previous.chunks.size() && previous.chunks[offset].fingerprint == print) {
+                    current.chunks.push_back(previous.chunks[offset]);
+                }
+                else {
+                    if (offset < previous.chunks.size())
+                        stale.push_back(previous.chunks[offset].root);
+                    build_chunk(ws, offset);
+                    // Chunks stored by an interrupted replot are picked up again
+                    plot_chunk(ws, true);
+                    current.chunks.push_back({print, ws.tree.root()});
+                }
+                progress.done = ++offset;
+            }
+            f.close();
+            for (size_t i = offset; i < previous.chunks.size(); i++)
+                stale.push_back(previous.chunks[i].root);
+
+            // Roots of identical chunks elsewhere in this input or in other inputs stay
+            std::set<Hash> drop(stale.begin(), stale.end());
+            for (const auto& c : current.chunks)
+                drop.erase(c.root);
+            for (const auto& entry : fs::directory_iterator(config.plot_dir)) {
+                if (drop.empty())
+                    break;
+                Manifest other;
+                if (entry.path().extension() != ".manifest" || entry.path() == fs::path(manifest_file) || !other.load(entry.path()))
+                    continue;
+                for (const auto& c : other.chunks)
+                    drop.erase(c.root);
+            }
+
+            std::vector<std::string> removed;
+            std::map<uint32_t, std::vector<uint32_t>> dead_records;
+            std::vector<size_t> slots;
+            auto before = search.snapshot();
+            for (const Hash& root : drop) {
+                auto entry = before->find(root);
+                if (!search.erase(root) || entry == nullptr)
+                    continue;
+                slots.push_back(entry->value.cache_slot);
+                // Stale plots packed in segments are marked dead so reloads
+                // skip them, and dropped by the next compact()
+                if (entry->value.segment == NO_SEGMENT)
+                    removed.push_back(config.plot_dir + "/" + root.to_string());
+                else
+                    dead_records[entry->value.segment].push_back(entry->value.record);
+            }
+            before.reset();
+
+            sync_plots();
+            auto old = search.snapshot();
+            search.publish();
+            RootIndex::wait_for_readers(old);
+            release_slots(slots);
+            for (const std::string& file : removed)
+                fs::remove(file);
+            for (const auto& d : dead_records)
+                mark_dead(d.first, d.second);
+            write_atomically(manifest_file, current.to_string());
+        }
+
+        /// @brief Replaces the lines of @p records in the .roots file of @p segment with DEAD_RECORD
+        void mark_dead(uint32_t segment, const std::vector<uint32_t>& records) {
+            std::string path = segment_path(segment) + ".roots";
+            std::vector<std::string> lines;
+            std::ifstream f(path);
+            for (std::string line; std::getline(f, line);)
+                lines.push_back(line);
+            f.close();
+            for (uint32_t record : records) {
+                if (record < lines.size())
+                    lines[record] = DEAD_RECORD;
+            }
+            std::string roots;
+            for (const std::string& line : lines)
+                roots += line + "\n";
+            write_atomically(path, roots);
+        }
+
+        /// @brief Salt for the encryption IV of a new input, 0 without encryption
+        uint64_t new_salt() const {
+            return config.encryption_key.empty() ? 0 : ChunkCipher::random_salt();
+        }
+
+        /// @brief Manifest file of an input
+        std::string manifest_path(const std::string& filename) const {
+            return config.plot_dir + "/" + fs::path(filename).filename().string() + ".manifest";
+        }
+
+        /// @brief Sidecar recording the encryption IV salt of an input
+        std::string salt_path(const std::string& filename) const {
+            return config.plot_dir + "/" + fs::path(filename).filename().string() + ".salt";
+        }
+
+        /// @brief Durably records the salt @p filename is plotted with, nothing without encryption
+        void save_salt(const std::string& filename, uint64_t salt) const {
+            if (salt != 0)
+                write_atomically(salt_path(filename), std::to_string(salt) + "\n");
+        }
+
+        /// @brief Salt the encryption IV of @p filename was last salted with, 0 if none was recorded
+        uint64_t load_salt(const std::string& filename) const {
+            std::ifstream f(salt_path(filename));
+            uint64_t salt = 0;
+            if (!(f >> salt))
+                return 0;
+            return salt;
+        }
+
+        /// @brief Reads the next chunk of an input into @p ws, encrypting it
+        /// in the same pass when a key is configured
+        /// @param offset Chunk number in the input, which selects the cipher counter
+        /// @return false once no complete chunk is left
+        bool read_chunk(std::ifstream& f, Workspace& ws, uint64_t offset) {
+            TraceScope trace("plot.read");
+            f.read(reinterpret_cast<char*>(ws.chunk.data()), ws.chunk.size());
+            if (static_cast<size_t>(f.gcount()) != ws.chunk.size())
+                return false;
+            if (ws.cipher)
+                ws.cipher->apply(ws.chunk.data(), ws.chunk.size(), offset * ws.chunk.size());
+            return true;
+        }
+
+        /// @brief Builds the tree of the chunk held in @p ws
+        void build_chunk(Workspace& ws, uint64_t offset) {
+            TraceScope trace("plot.build");
+            ws.tree.begin(offset);
+            for (size_t i = 0; i < LEAVES; i++)
+                ws.tree.push(Hash(ws.chunk.data() + i * HASH_SIZE));
+        }
+
+        /// @brief Fingerprint of the chunk held in @p ws
+        static merkle::HashT<32> fingerprint(const Workspace& ws) {
+            merkle::HashT<32> h;
+            SHA256(ws.chunk.data(), ws.chunk.size(), h.bytes);
+            return h;
+        }
+
+        /// @brief Checkpoint file of a plot run over @p filename
+        std::string checkpoint_path(const std::string& filename) const {
+            return config.plot_dir + "/" + fs::path(filename).filename().string() + ".checkpoint";
+        }
+
+        /// @brief Flushes the plot files written since the last checkpoint
+        void sync_plots() {
+            for (const std::string& file : unsynced)
+                fsync_path(file);
+            unsynced.clear();
+            fsync_path(config.plot_dir);
+        }
+
+        /// @brief Makes all plots so far durable, then records @p checkpoint
+        void save_checkpoint(const std::string& path, const Checkpoint& checkpoint) {
+            sync_plots();
+            write_atomically(path, checkpoint.to_string());
+        }
+
+        /// @brief Size of a complete plot file
+        size_t plot_file_size() const {
+            if (config.leaves_only)
+                return sizeof(uint64_t) + (LEAVES + stored_top_nodes()) * HASH_SIZE;
+            return layout.size();
+        }
+
+        /// @brief Whether @p file is this chunk's own plot left behind by an interrupted run
+        bool interrupted_plot(const std::string& file, uint64_t offset) const {
+            std::ifstream f(file, std::ifstream::binary);
+            uint8_t header[sizeof(uint64_t)];
+            if (!f.read(reinterpret_cast<char*>(header), sizeof(header)) || fs::file_size(file) < plot_file_size())
+                return true;
+            size_t position = 0;
+            return merkle::deserialise_uint64_t(std::vector<uint8_t>(header, header + sizeof(header)), position) == offset;
+        }
+
+        /// @brief Encodes the tree built in @p ws, stores it and adds its root to the index
+        /// @param ws Workspace holding the built tree
+        /// @param resuming Whether chunks may have been stored by an interrupted run
+        ///
+        /// The root stays invisible to concurrent provers until the caller
+        /// publishes the index, which is always after the file is complete.
+        void plot_chunk(Workspace& ws, bool resuming = false) {
+            Tree& tree = ws.tree;
+            encode_chunk(ws);
+
+            const std::string& filename = plot_filename(ws);
+            bool indexed = search.contains(tree.root());
+            if (indexed) {
+                // Chunks after the last checkpoint are redone, everything else is a conflict
+                auto entry = search.snapshot()->find(tree.root());
+                bool standalone = entry == nullptr || entry->value.segment == NO_SEGMENT;
+                if (!resuming || !standalone || !interrupted_plot(filename, tree.file_offset)) {
+                    conflicts++;
+                    return;
+                }
+                fs::remove(filename);
+            }
+
+            store_chunk(ws);
+            if (config.checkpoint_interval > 0 || config.manifest)
+                unsynced.push_back(filename);
+
+            if (!indexed)
+                index_chunk(tree);
+            plots++;
+        }
+
+        /// @brief Like plot_chunk() but safe to call from several workers
+        /// @param ws Workspace of the calling worker
+        /// @param writer Guards the index, the cache and @p claimed
+        /// @param claimed Roots being stored by some worker, not indexed yet
+        void plot_chunk(Workspace& ws, std::mutex& writer, std::set<Hash>& claimed) {
+            Tree& tree = ws.tree;
+            encode_chunk(ws);
+
+            Hash root = tree.root();
+            {
+                auto lock = traced_lock(writer, "plot.writer_wait");
+                if (search.contains(root) || !claimed.insert(root).second) {
+                    conflicts++;
+                    return;
+                }
+            }
+            try {
+                store_chunk(ws);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(writer);
+                claimed.erase(root);
+                throw;
+            }
+
+            auto lock = traced_lock(writer, "plot.writer_wait");
+            claimed.erase(root);
+            index_chunk(tree);
+            search.maybe_publish();
+            plots++;
+        }
+
+        /// @brief Encodes the tree built in @p ws, keeping the raw leaves for leaves-only plots
+        void encode_chunk(Workspace& ws) {
+            TraceScope trace("plot.encode");
+            if (config.leaves_only)
+                ws.leaves.assign(ws.tree.nodes.begin(), ws.tree.nodes.begin() + LEAVES);
+            encode(ws.tree.nodes);
+        }
+
+        /// @brief Path of the plot file of the tree in @p ws, built in the workspace's buffer
+        const std::string& plot_filename(Workspace& ws) const {
+            ws.filename.assign(config.plot_dir).push_back('/');
+            size_t n = ws.filename.size();
+            ws.filename.resize(n + 2 * HASH_SIZE);
+            merkle::hex_encode(ws.tree.nodes.back().bytes, HASH_SIZE, &ws.filename[n]);
+            return ws.filename;
+        }
+
+        /// @brief Writes the encoded tree in @p ws to its plot file, which must not exist yet
+        ///
+        /// The file is laid out in the workspace's buffer and written in one go.
+        void store_chunk(Workspace& ws) {
+            TraceScope trace("plot.serialize");
+            if (config.leaves_only)
+                ws.tree.serialise(ws.file, ws.leaves, stored_top_nodes());
+            else
+                ws.tree.serialise(ws.file, layout);
+            write_new_file(plot_filename(ws), ws.file.data(), ws.file.size());
+        }
+
+        /// @brief Adds a stored tree to the index (writer only)
+        void index_chunk(Tree& tree) {
+            TraceScope trace("plot.index");
+            Location location;
+            location.cache_slot = cache_top_nodes(tree.nodes.data() + TOTAL - cached_top_nodes());
+            search.insert(tree.root(), location);
+        }
+
+        /// @brief Checks every file of the plot store against its name and the index
+        /// @param threads Number of verifying threads, 0 uses one per core
+        /// @param quarantine Drop corrupt plots from the index and move them and
+        /// the orphans to <plot_dir>/quarantine
+        ///
+        /// Each plot is read sequentially in one go, decoded and its internal
+        /// nodes are hashed again from the leaves. Must be called from the
+        /// plotting thread; proofs can be generated meanwhile.
+        AuditReport audit(size_t threads = 0, bool quarantine = false) {
+            AuditReport report;
+            auto snapshot = search.snapshot();
+
+            std::vector<std::pair<Hash, Location>> plots;
+            std::set<Hash> found;
+            std::set<uint32_t> segments;
+            for (const auto& entry : fs::directory_iterator(config.plot_dir)) {
+                if (!entry.is_regular_file())
+                    continue;
+                std::string name = entry.path().filename();
+                Hash h;
+                uint32_t segment = 0;
+                if (parse_segment(name, "", segment) || parse_segment(name, ".roots", segment)) {
+                    segments.insert(segment);
+                    continue;
+                }
+                if (name.size() != 2 * HASH_SIZE || !merkle::hex_decode(name.data(), HASH_SIZE, h.bytes)) {
+                    std::string extension = entry.path().extension();
+                    if (extension != ".checkpoint" && extension != ".manifest" && extension != ".salt")
+                        report.orphans.push_back(entry.path());
+                    continue;
+                }
+                found.insert(h);
+                auto indexed = snapshot->find(h);
+                if (snapshot->size() > 0 && (indexed == nullptr || indexed->value.segment != NO_SEGMENT))
+                    report.orphans.push_back(entry.path());
+                else
+                    plots.push_back({h, Location()});
+            }
+            for (const auto& entry : *snapshot) {
+                if (entry.value.segment != NO_SEGMENT && segments.count(entry.value.segment) > 0)
+                    plots.push_back({entry.root, entry.value});
+                else if (entry.value.segment != NO_SEGMENT || found.count(entry.root) == 0)
+                    report.missing.push_back(plot_path(entry.root, entry.value));
+            }
+            snapshot.reset();
+
+            if (threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            std::atomic<size_t> next(0);
+            std::mutex m;
+            std::vector<Hash> bad;
+            std::vector<std::string> quarantined;
+            std::vector<std::thread> workers;
+            for (size_t t = 0; t < std::min(threads, plots.size()); t++) {
+                workers.emplace_back([&]() {
+                    Workspace ws(config);
+                    for (size_t i = next++; i < plots.size(); i = next++) {
+                        const Hash& root = plots[i].first;
+                        const Location& location = plots[i].second;
+                        if (audit_plot(root, location, ws))
+                            continue;
+                        std::lock_guard<std::mutex> lock(m);
+                        bad.push_back(root);
+                        std::string path = plot_path(root, location);
+                        if (location.segment == NO_SEGMENT) {
+                            report.corrupt.push_back(path);
+                            quarantined.push_back(path);
+                        }
+                        else {
+                            // Records of segments are left for compact() to drop
+                            report.corrupt.push_back(path + "@" + std::to_string(location.record));
+                        }
+                    }
+                });
+            }
+            for (auto& w : workers)
+                w.join();
+            report.checked = plots.size();
+
+            if (quarantine && !(report.corrupt.empty() && report.orphans.empty())) {
+                auto old = search.snapshot();
+                std::vector<size_t> slots;
+                for (const Hash& h : bad) {
+                    auto entry = old->find(h);
+                    if (search.erase(h) && entry != nullptr)
+                        slots.push_back(entry->value.cache_slot);
+                }
+                search.publish();
+                RootIndex::wait_for_readers(old);
+                release_slots(slots);
+
+                fs::path dir = fs::path(config.plot_dir) / "quarantine";
+                fs::create_directories(dir);
+                quarantined.insert(quarantined.end(), report.orphans.begin(), report.orphans.end());
+                for (const std::string& file : quarantined)
+                    fs::rename(file, dir / fs::path(file).filename());
+                fsync_path(dir);
+                fsync_path(config.plot_dir);
+            }
+            return report;
+        }
+
+        /// @brief Recomputes a stored plot and compares it with its root
+        /// @param root The root the plot is named or indexed by
+        /// @param location Where the plot is stored
+        /// @param ws Workspace of the calling thread, whose buffers are reused across calls
+        /// @return false if the plot is torn or any node does not match
+        bool audit_plot(const Hash& root, const Location& location, Workspace& ws) {
+            std::vector<uint8_t>& bytes = ws.file;
+            auto& raw = ws.tree.nodes;
+            std::vector<Hash>& enc = ws.encoded;
+            raw.resize(TOTAL);
+            enc.resize(TOTAL);
+
+            std::ifstream f(plot_path(root, location), std::ifstream::binary);
+            bytes.resize(plot_file_size());
+            f.seekg(plot_base(location));
+            if (!f.read(reinterpret_cast<char*>(bytes.data()), bytes.size()))
+                return false;
+            if (location.segment == NO_SEGMENT && f.peek() != EOF)
+                return false;
+
+            const std::vector<int>& dep = dependencies;
+            if (config.leaves_only) {
+                for (size_t i = 0; i < LEAVES; i++)
+                    std::copy_n(bytes.data() + sizeof(uint64_t) + i * HASH_SIZE, HASH_SIZE, raw[i].bytes);
+            }
+            else {
+                for (size_t i = 0; i < TOTAL; i++)
+                    std::copy_n(bytes.data() + layout.position(i), HASH_SIZE, enc[i].bytes);
+                for (size_t i = 0; i < TOTAL; i++) {
+                    raw[i] = enc[i];
+                    if (i != TOTAL - 1)
+                        raw[i] ^= enc[dep[i]];
+                    vdd(raw[i]);
+                }
+            }
+
+            // Hash every level again from the leaves
+            size_t base = 0;
+            for (size_t width = LEAVES; width > 1; width /= FANOUT) {
+                for (size_t j = 0; j < width / FANOUT; j++) {
+                    Hash h;
+                    HASH_FUNCTION(raw.data() + base + j * FANOUT, FANOUT, h);
+                    if (config.leaves_only)
+                        raw[base + width + j] = h;
+                    else if (h != raw[base + width + j])
+                        return false;
+                }
+                base += width;
+            }
+            if (raw[TOTAL - 1] != root)
+                return false;
+
+            if (config.leaves_only) {
+                enc.assign(raw.begin(), raw.end());
+                encode(enc);
+                size_t top = stored_top_nodes();
+                const uint8_t* stored = bytes.data() + sizeof(uint64_t) + LEAVES * HASH_SIZE;
+                for (size_t i = 0; i < top; i++) {
+                    if (!std::equal(stored + i * HASH_SIZE, stored + (i + 1) * HASH_SIZE, enc[TOTAL - top + i].bytes))
+                        return false;
+                }
+            }
+            return true;
+        }
+
+        /// @brief Packs live plots into segments and deletes dead plots and leftovers
+        ///
+        /// Plot files, and segments that hold dead records, are copied live
+        /// plots only into new segments of up to PlotConfig::segment_records
+        /// plots, at no more than PlotConfig::compaction_rate bytes per second.
+        /// The index then points at the copies in one publish, and the old
+        /// files are deleted once no prover holds the previous snapshot.
+        /// Plots missing from the index, torn plot files and temporary files
+        /// of interrupted writes are dead. Must be called from the plotting
+        /// thread after load_plot(); proofs can be generated meanwhile.
+        CompactionReport compact() {
+            typedef typename RootIndex::Entry Entry;
+            CompactionReport report;
+            auto snapshot = search.snapshot();
+            if (snapshot->size() == 0)
+                throw std::runtime_error("Load the plot index before compacting");
+
+            const size_t record_size = plot_file_size();
+            std::map<uint32_t, size_t> live;
+            for (const auto& entry : *snapshot) {
+                if (entry.value.segment != NO_SEGMENT)
+                    live[entry.value.segment]++;
+            }
+
+            std::vector<Entry> moving;
+            std::vector<std::string> dead;
+            std::vector<size_t> slots;
+            std::map<uint32_t, size_t> records;
+            for (const auto& entry : fs::directory_iterator(config.plot_dir)) {
+                if (!entry.is_regular_file())
+                    continue;
+                std::string name = entry.path().filename();
+                Hash h;
+                uint32_t segment = 0;
+                if (parse_segment(name, "", segment)) {
+                    records[segment] += entry.file_size() / record_size;
+                }
+                else if (parse_segment(name, ".roots", segment)) {
+                    records[segment] += 0;
+                }
+                else if (name.size() == 2 * HASH_SIZE && merkle::hex_decode(name.data(), HASH_SIZE, h.bytes)) {
+                    auto indexed = snapshot->find(h);
+                    if (indexed == nullptr || indexed->value.segment != NO_SEGMENT) {
+                        dead.push_back(entry.path());
+                    }
+                    else if (entry.file_size() != record_size) {
+                        search.erase(h);
+                        slots.push_back(indexed->value.cache_slot);
+                        dead.push_back(entry.path());
+                    }
+                    else {
+                        moving.push_back(*indexed);
+                    }
+                }
+                else if (entry.path().extension() == ".tmp") {
+                    dead.push_back(entry.path());
+                }
+            }
+
+            // Segments without live plots are dropped, partly dead ones rewritten
+            std::set<uint32_t> rewrite;
+            for (const auto& r : records) {
+                next_segment = std::max(next_segment, r.first + 1);
+                auto l = live.find(r.first);
+                if (l == live.end()) {
+                    dead.push_back(segment_path(r.first) + ".roots");
+                    dead.push_back(segment_path(r.first));
+                }
+                else if (l->second < r.second) {
+                    rewrite.insert(r.first);
+                }
+            }
+            for (const auto& entry : *snapshot) {
+                if (rewrite.count(entry.value.segment) > 0)
+                    moving.push_back(entry);
+            }
+            std::sort(moving.begin(), moving.end(), [](const Entry& a, const Entry& b) {
+                if (a.value.segment != b.value.segment)
+                    return a.value.segment < b.value.segment;
+                return a.value.segment == NO_SEGMENT ? a.root < b.root : a.value.record < b.value.record;
+            });
+
+            // Copy the live plots, each segment is committed by its roots file
+            std::vector<uint8_t> bytes(record_size);
+            auto start = std::chrono::steady_clock::now();
+            size_t copied = 0;
+            for (size_t first = 0; first < moving.size(); first += config.segment_records) {
+                size_t count = std::min(config.segment_records, moving.size() - first);
+                uint32_t segment = next_segment++;
+                std::string path = segment_path(segment);
+                std::ofstream out(path, std::ofstream::binary | std::ofstream::trunc);
+                std::string roots;
+                for (size_t i = 0; i < count; i++) {
+                    const Entry& entry = moving[first + i];
+                    std::ifstream in(plot_path(entry.root, entry.value), std::ifstream::binary);
+                    in.seekg(plot_base(entry.value));
+                    if (!in.read(reinterpret_cast<char*>(bytes.data()), bytes.size()))
+                        throw std::runtime_error("Cannot read plot " + entry.root.to_string());
+                    out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+                    roots += entry.root.to_string() + "\n";
+
+                    copied += record_size;
+                    if (config.compaction_rate > 0)
+                        std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                            std::chrono::duration<double>(double(copied) / config.compaction_rate)));
+                }
+                out.close();
+                if (!out)
+                    throw std::runtime_error("Cannot write " + path);
+                fsync_path(path);
+                write_atomically(path + ".roots", roots);
+
+                for (size_t i = 0; i < count; i++) {
+                    const Entry& entry = moving[first + i];
+                    Location location = entry.value;
+                    location.segment = segment;
+                    location.record = i;
+                    search.assign(entry.root, location);
+                }
+                report.segments++;
+            }
+            report.moved = moving.size();
+
+            search.publish();
+            RootIndex::wait_for_readers(snapshot);
+            release_slots(slots);
+
+            for (const Entry& entry : moving) {
+                if (entry.value.segment == NO_SEGMENT)
+                    dead.push_back(plot_path(entry.root, entry.value));
+            }
+            for (uint32_t segment : rewrite) {
+                dead.push_back(segment_path(segment) + ".roots");
+                dead.push_back(segment_path(segment));
+            }
+            for (const std::string& file : dead) {
+                std::error_code ec;
+                size_t size = fs::file_size(file, ec);
+                if (fs::remove(file, ec)) {
+                    report.deleted++;
+                    report.reclaimed += size;
+                }
+            }
+            fsync_path(config.plot_dir);
+            return report;
+        }
+
+        static std::vector<int> get_path_indexes(int index) {
             std::vector<int> indexes;
 
             int n = index / FANOUT;
@@ -326,27 +1678,165 @@ namespace por {
 
         /// @brief Generates a Proof from the plot given a challenge
         /// @param challenge 
+        ///
+        /// Safe to call while another thread is plotting.
         Proof generate_proof(Hash challenge) {
-            std::vector<int> indexes = get_path_indexes(challenge % LEAVES);
-            auto closest = *closest_element(search, challenge);
+            auto snapshot = search.snapshot();
+            auto entry = snapshot->closest(challenge);
+            if (entry == nullptr)
+                throw std::runtime_error("No plots to prove from");
+            return generate_proof(challenge, *entry);
+        }
 
-            std::ifstream f("plot/" + closest.to_string(), std::ifstream::binary);
-            if (!f.good())
-                throw std::runtime_error( "Invalid plot file" );
+        /// @brief Generates a Proof of @p challenge from the plot of @p entry
+        /// @param entry An entry of a snapshot the caller holds until this returns
+        Proof generate_proof(const Hash& challenge, const typename RootIndex::Entry& entry) {
+            TraceScope trace("prove");
+            int leaf = challenge % LEAVES;
+            std::vector<int> indexes = get_path_indexes(leaf);
+
+            const Hash& closest = entry.root;
+            const Location& location = entry.value;
 
-            std::vector<uint8_t> bytes;
-            char t;
-            while (!f.eof()) {
-                f.read(&t, 1);
-                bytes.push_back(t);
+            if (location.cache_slot != NO_SLOT) {
+                size_t count = cached_top_nodes();
+                return read_proof(closest, location, indexes, cache.data() + location.cache_slot * count, count);
             }
-            f.close();
+            if (config.layout != merkle::Layout::level)
+                return read_proof(closest, location, indexes, nullptr, 0);
+            if (config.leaves_only)
+                return rebuild_proof(closest, location, indexes, leaf);
 
-            Proof proof(bytes, indexes);
+            std::vector<uint8_t> bytes(plot_file_size());
+            {
+                TraceScope read("prove.read");
+                std::ifstream f(plot_path(closest, location), std::ifstream::binary);
+                f.seekg(plot_base(location));
+                if (!f.read(reinterpret_cast<char*>(bytes.data()), bytes.size()))
+                    throw std::runtime_error( "Invalid plot file" );
+            }
+
+            Proof proof(bytes, indexes, layout);
             return proof;
         
         }
 
+        /// @brief Byte positions of a path in the plot files
+        /// @param index The challenged leaf
+        std::vector<size_t> get_path_positions(int index) {
+            std::vector<size_t> positions;
+            for (int i : get_path_indexes(index))
+                positions.push_back(layout.position(i));
+            return positions;
+        }
+
+        /// @brief Builds a proof by reading only the path nodes that are not cached
+        /// @param root Root of the plot
+        /// @param location Where the plot is stored
+        /// @param indexes Path indexes of the challenged leaf
+        /// @param top Cached top nodes of the plot
+        /// @param count Number of cached top nodes
+        Proof read_proof(const Hash& root, const Location& location, const std::vector<int>& indexes, const Hash* top, size_t count) {
+            TraceScope trace("prove.read");
+            std::ifstream f;
+            Proof proof;
+            for (size_t i = 0; i < proof.n; i++) {
+                size_t index = indexes.at(i);
+                if (index >= TOTAL - count) {
+                    proof.hashes.push_back(top[index - (TOTAL - count)]);
+                    continue;
+                }
+
+                if (!f.is_open())
+                    f.open(plot_path(root, location), std::ifstream::binary);
+                Hash h;
+                f.seekg(plot_base(location) + layout.position(index));
+                f.read(reinterpret_cast<char*>(h.bytes), HASH_SIZE);
+                if (!f.good())
+                    throw std::runtime_error( "Invalid plot file" );
+                proof.hashes.push_back(h);
+            }
+            return proof;
+        }
+
+        /// @brief Number of nodes stored after the leaves in leaves-only mode
+        size_t stored_top_nodes() const {
+            size_t levels = std::min(config.top_levels, DEPTH);
+            return (ipow(FANOUT, levels) - 1) / (FANOUT - 1);
+        }
+
+        /// @brief Rebuilds the encoded path of a leaf from a leaves-only plot
+        /// @param root Root of the plot
+        /// @param location Where the plot is stored
+        /// @param indexes Path indexes of @p leaf
+        /// @param leaf The challenged leaf
+        ///
+        /// Only the leaves of the subtree below the lowest stored level are
+        /// read and hashed again, into buffers the thread reuses. Every node
+        /// is chained to a path node one level up, so encoding the path nodes
+        /// alone needs no other node.
+        Proof rebuild_proof(const Hash& root, const Location& location, const std::vector<int>& indexes, int leaf) {
+            TraceScope trace("prove.rebuild");
+            static_assert(sizeof(Hash) == HASH_SIZE, "Plot files are read straight into hashes");
+            const size_t top = stored_top_nodes();
+            const size_t height = std::min(DEPTH, DEPTH + 1 - std::min(config.top_levels, DEPTH));
+            const size_t width = ipow(FANOUT, height);
+            const size_t subtree = leaf / width;
+
+            thread_local std::vector<Hash> raw, stored;
+            raw.resize((FANOUT * width - 1) / (FANOUT - 1));
+            stored.resize(top);
+            {
+                TraceScope read("prove.read");
+                std::ifstream f(plot_path(root, location), std::ifstream::binary);
+                size_t leaves = plot_base(location) + sizeof(uint64_t);
+                f.seekg(leaves + subtree * width * HASH_SIZE);
+                f.read(reinterpret_cast<char*>(raw.data()), width * HASH_SIZE);
+                f.seekg(leaves + LEAVES * HASH_SIZE);
+                f.read(reinterpret_cast<char*>(stored.data()), top * HASH_SIZE);
+                if (!f.good())
+                    throw std::runtime_error( "Invalid plot file" );
+            }
+
+            // Hash the subtree level by level, each level right after the one below
+            size_t base = 0;
+            for (size_t count = width; count > 1; count /= FANOUT) {
+                for (size_t j = 0; j < count / FANOUT; j++)
+                    HASH_FUNCTION(raw.data() + base + j * FANOUT, FANOUT, raw[base + count + j]);
+                base += count;
+            }
+
+            // Gather the raw path bottom-up, taking stored nodes as they are
+            Proof proof;
+            proof.hashes.resize(proof.n);
+            size_t level = 0, level_base = 0, subtree_base = 0, subtree_width = width;
+            for (size_t i = 0; i < proof.n; i++) {
+                for (size_t l = i < FANOUT ? 0 : 1 + (i - FANOUT) / (FANOUT - 1); level < l; level++) {
+                    level_base += LEAVES / ipow(FANOUT, level);
+                    subtree_base += subtree_width;
+                    subtree_width /= FANOUT;
+                }
+                size_t node = indexes.at(i);
+                size_t first = level_base + subtree * subtree_width;
+                if (node >= TOTAL - top)
+                    proof.hashes[i] = stored[node - (TOTAL - top)];
+                else if (level <= height && node >= first && node < first + subtree_width)
+                    proof.hashes[i] = raw[subtree_base + node - first];
+                else
+                    throw std::runtime_error("Plot does not store enough levels to rebuild the proof");
+            }
+
+            // Encodings are chained towards the root, so encode top-down
+            for (size_t i = proof.n; i-- > 0;) {
+                if (size_t(indexes[i]) >= TOTAL - top)
+                    continue;
+                if (i != proof.n - 1)
+                    proof.hashes[i] ^= proof.hashes[next_level(i)];
+                vde(proof.hashes[i]);
+            }
+            return proof;
+        }
+
         /// @brief Computes the Merkle root from a path
         /// @param p Proof that contains the hashes from a Merkle path
         /// @param indexes Set of indexes that indicate the order of the path in the proof
@@ -362,7 +1852,7 @@ namespace por {
             int level = 1;
             int index;
             for (int i = 0; i < logb(LEAVES, FANOUT); i++) {
-                HASH_FUNCTION(values, FANOUT * i, FANOUT, res);
+                HASH_FUNCTION(values.data() + FANOUT * i, FANOUT, res);
                 node = base + (int)indexes.at(0)/(pow(FANOUT,level));
                 int n = 0;
                 index = values.size() - i;
@@ -384,6 +1874,7 @@ namespace por {
         }
 
         bool verify(Proof p, Hash challenge) {
+            TraceScope trace("verify");
             std::vector<int> indexes = get_path_indexes(challenge % LEAVES);
             Proof d = decode(p);
             Hash root = compute_root(&d, indexes);
@@ -412,9 +1903,32 @@ namespace por {
         }
 
         // protected:
-        std::set<Hash> search;
-        int conflicts = 0;
-        int plots = 0;
+        PlotConfig config;
+        NodeLayout layout;
+        /// @brief Node each node's encoding is chained to, see dependency_table()
+        const std::vector<int>& dependencies;
+        RootIndex search;
+
+        /// @brief Contiguous arena with the cached top nodes of every cached plot
+        std::vector<Hash> cache;
+        /// @brief Slots handed out so far, including the free ones
+        size_t cache_used = 0;
+        size_t cache_capacity = 0;
+        /// @brief Slots of removed plots, reused before new ones
+        std::vector<size_t> free_slots;
+        std::atomic<int> conflicts{0};
+        std::atomic<int> plots{0};
+        /// @brief Progress of the running plot call
+        Progress progress;
+
+        /// @brief Plot files written since the last checkpoint
+        std::vector<std::string> unsynced;
+        /// @brief Id of the next segment written by compact()
+        uint32_t next_segment = 0;
+        /// @brief Modification time of the .roots of every segment read, see rescan()
+        std::map<uint32_t, fs::file_time_type> segment_times;
+        /// @brief Copies in segments of roots indexed elsewhere, where rescan() moves them once that copy goes
+        std::map<Hash, Location> shadowed;
     };
 
     typedef PoRepT<32, merkle::sha256, 2, 64> PoRep;
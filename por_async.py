@@ -0,0 +1,64 @@
+"""asyncio front end of por_binding.AsyncProver.
+
+    prover = AsyncProver(porep)
+    proofs = await prover.generate_proofs(challenges)
+    valid = await prover.verify(proofs, challenges)
+    prover.close()
+
+Batches run on the C++ thread pool; the event loop is woken through the
+pool's eventfd, so in-flight operations need no Python thread each.
+"""
+import asyncio
+
+import por_binding
+
+
+class AsyncProver:
+    def __init__(self, porep, threads=0, loop=None):
+        self._pool = por_binding.AsyncProver(porep, threads)
+        self._loop = loop or asyncio.get_running_loop()
+        self._pending = {}
+        self._closed = False
+        self._loop.add_reader(self._pool.fd(), self._drain)
+
+    def generate_proofs(self, challenges):
+        """Future of the proofs of challenges (hex strings or 32 bytes each)."""
+        self._check_open()
+        return self._track(self._pool.submit_proofs(challenges))
+
+    async def generate_proof(self, challenge):
+        return (await self.generate_proofs([challenge]))[0]
+
+    def verify(self, proofs, challenges):
+        """Future of one bool per proof."""
+        self._check_open()
+        return self._track(self._pool.submit_verify(proofs, challenges))
+
+    def close(self):
+        """Stops listening; pending futures are cancelled and new calls fail."""
+        if self._closed:
+            return
+        self._closed = True
+        self._loop.remove_reader(self._pool.fd())
+        for future in self._pending.values():
+            future.cancel()
+        self._pending.clear()
+
+    def _check_open(self):
+        if self._closed:
+            raise RuntimeError("AsyncProver is closed")
+
+    def _track(self, ticket):
+        future = self._loop.create_future()
+        self._pending[ticket] = future
+        return future
+
+    def _drain(self):
+        for ticket, error, results in self._pool.poll():
+            future = self._pending.pop(ticket, None)
+            if future is None or future.done():
+                continue
+            if error is not None:
+                future.set_exception(RuntimeError(error))
+            else:
+                future.set_result(results)
@@ -0,0 +1,107 @@
+#include "prover.hpp"
+#include <csignal>
+#include <iostream>
+
+// Usage: ./prover [plot_dir] [socket] [rescan_seconds] [options]
+// Options, which must match how the store was plotted where noted:
+//   --cache-levels <n>       top levels of every plot kept in memory, see PlotConfig::cache_levels
+//   --cache-budget <bytes>   memory for those levels, 0 disables the cache
+//   --layout <level|blocked> node order of the plot files (must match)
+//   --block-size <bytes>     block size of the blocked layout (must match)
+//   --leaves-only <levels>   plots store the leaves plus <levels> top levels (must match)
+//   --compact-index          keep 8-byte root prefixes in memory, see PlotConfig::compact_index
+//   --index-delay <ms>       longest time a rescanned root stays invisible
+static volatile sig_atomic_t stop = 0;
+
+static void on_signal(int) {
+    stop = 1;
+}
+
+static void usage(const char* name) {
+    std::cerr << "Usage: " << name << " [plot_dir] [socket] [rescan_seconds] [--cache-levels <n>] [--cache-budget <bytes>]"
+              << " [--layout <level|blocked>] [--block-size <bytes>] [--leaves-only <levels>] [--compact-index] [--index-delay <ms>]\n";
+}
+
+int main(int argc, char** argv) {
+    por::PlotConfig config;
+    std::string socket_path = "por.sock";
+    int rescan = 0;
+
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--cache-levels" && has_value)
+            config.cache_levels = std::stoul(argv[++i]);
+        else if (arg == "--cache-budget" && has_value)
+            config.cache_budget = std::stoul(argv[++i]);
+        else if (arg == "--layout" && has_value) {
+            std::string layout = argv[++i];
+            if (layout == "level")
+                config.layout = merkle::Layout::level;
+            else if (layout == "blocked")
+                config.layout = merkle::Layout::blocked;
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (arg == "--block-size" && has_value)
+            config.block_size = std::stoul(argv[++i]);
+        else if (arg == "--leaves-only" && has_value) {
+            config.leaves_only = true;
+            config.top_levels = std::stoul(argv[++i]);
+        }
+        else if (arg == "--compact-index")
+            config.compact_index = true;
+        else if (arg == "--index-delay" && has_value)
+            config.index_delay = std::stoul(argv[++i]);
+        else if (arg.rfind("--", 0) == 0) {
+            usage(argv[0]);
+            return 1;
+        }
+        else
+            positional.push_back(arg);
+    }
+    if (positional.size() > 0)
+        config.plot_dir = positional[0];
+    if (positional.size() > 1)
+        socket_path = positional[1];
+    if (positional.size() > 2)
+        rescan = std::stoi(positional[2]);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    // POR_TRACE=<file> writes a Chrome trace of the run at shutdown
+    const char* trace_file = getenv("POR_TRACE");
+    if (trace_file != nullptr)
+        por::Tracer::instance().start();
+
+    por::PoRep p(config);
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    p.load_plot(config.plot_dir);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    std::cout << "Plots: " << p.search.size() << std::endl;
+    if (config.cache_budget > 0)
+        std::cout << "Cached levels: " << config.cache_levels << " (" << config.cache_budget << " bytes)" << std::endl;
+    std::cout << "Load time = " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << "[ms]" << std::endl;
+
+    por::ProverServerT<por::PoRep> server(p, socket_path);
+    std::cout << "Listening on " << socket_path << std::endl;
+
+    std::chrono::steady_clock::time_point scanned = std::chrono::steady_clock::now();
+    while (!stop) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (rescan > 0 && std::chrono::steady_clock::now() - scanned >= std::chrono::seconds(rescan)) {
+            por::RescanReport r = server.rescan();
+            if (r.added + r.moved + r.dropped > 0)
+                std::cout << "Rescan: " << r.added << " added, " << r.moved << " moved, " << r.dropped << " dropped, "
+                          << p.search.size() << " plots" << std::endl;
+            scanned = std::chrono::steady_clock::now();
+        }
+    }
+    std::cout << "Served: " << server.served() << std::endl;
+    if (trace_file != nullptr)
+        por::Tracer::instance().dump(trace_file);
+}
@@ -0,0 +1,322 @@
+#pragma once
+
+#include "por.hpp"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <cstring>
+#include <list>
+
+namespace por {
+
+    /// @brief Binary protocol of the prover daemon
+    ///
+    /// Request: type (1 byte), count (4 bytes, big-endian), count challenges.
+    /// Response: status (1 byte), count (4 bytes, big-endian), then count
+    /// proofs of Proof::n hashes each, or an error message of count bytes.
+    namespace protocol {
+        enum Type : uint8_t {
+            /// @brief A single challenge
+            PROVE = 1,
+            /// @brief Up to MAX_BATCH challenges answered in order
+            PROVE_BATCH = 2
+        };
+
+        enum Status : uint8_t {
+            OK = 0,
+            ERROR = 1
+        };
+
+        /// @brief Largest batch a server accepts
+        static constexpr uint32_t MAX_BATCH = 1 << 16;
+
+        static constexpr size_t HEADER = 1 + sizeof(uint32_t);
+
+        static inline void store_header(uint8_t code, uint32_t count, uint8_t* out)
+        {
+            out[0] = code;
+            for (size_t i = 0; i < sizeof(uint32_t); i++)
+                out[1 + i] = static_cast<uint8_t>(count >> (8 * (sizeof(uint32_t) - 1 - i)));
+        }
+
+        static inline uint32_t load_count(const uint8_t* header)
+        {
+            uint32_t count = 0;
+            for (size_t i = 0; i < sizeof(uint32_t); i++)
+                count = count << 8 | header[1 + i];
+            return count;
+        }
+
+        /// @brief Reads exactly @p n bytes
+        /// @return false if the peer closed the connection first
+        static inline bool read_full(int fd, void* buffer, size_t n)
+        {
+            uint8_t* p = static_cast<uint8_t*>(buffer);
+            while (n > 0) {
+                ssize_t r = read(fd, p, n);
+                if (r < 0 && errno == EINTR)
+                    continue;
+                if (r <= 0)
+                    return false;
+                p += r;
+                n -= r;
+            }
+            return true;
+        }
+
+        /// @brief Writes exactly @p n bytes
+        /// @return false if the peer is gone
+        static inline bool write_full(int fd, const void* buffer, size_t n)
+        {
+            const uint8_t* p = static_cast<const uint8_t*>(buffer);
+            while (n > 0) {
+                ssize_t r = send(fd, p, n, MSG_NOSIGNAL);
+                if (r < 0 && errno == EINTR)
+                    continue;
+                if (r <= 0)
+                    return false;
+                p += r;
+                n -= r;
+            }
+            return true;
+        }
+
+        static inline sockaddr_un address(const std::string& path)
+        {
+            sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            if (path.size() >= sizeof(addr.sun_path))
+                throw std::runtime_error("Socket path too long: " + path);
+            memcpy(addr.sun_path, path.c_str(), path.size());
+            return addr;
+        }
+    }
+
+    /// @brief Resident prover answering challenges over a Unix-domain socket
+    ///
+    /// The root index and the top-level cache stay loaded across requests.
+    /// Every connection is served by its own thread, proofs being safe to
+    /// generate concurrently; the thread owning the server remains the index
+    /// writer and can pick up new and deleted plots with rescan().
+    /// @tparam PoRep The PoRepT instantiation to serve
+    template <class PoRep>
+    class ProverServerT {
+        public:
+            typedef typename PoRep::Hash Hash;
+            typedef typename PoRep::Proof Proof;
+
+            /// @brief Binds the socket, replacing a stale one left at @p path
+            /// @param porep Prover with its plots loaded
+            /// @param path Socket path
+            ProverServerT(PoRep& porep, const std::string& path) :
+                porep(porep), path(path)
+            {
+                sockaddr_un addr = protocol::address(path);
+                listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                if (listener < 0)
+                    throw std::runtime_error("Cannot create socket");
+                unlink(path.c_str());
+                if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener, 128) != 0) {
+                    close(listener);
+                    throw std::runtime_error("Cannot listen on " + path);
+                }
+                acceptor = std::thread(&ProverServerT::accept_loop, this);
+            }
+
+            ProverServerT(const ProverServerT&) = delete;
+            ProverServerT& operator=(const ProverServerT&) = delete;
+
+            /// @brief Stops accepting, closes all connections and removes the socket
+            ~ProverServerT() {
+                stopping = true;
+                acceptor.join();
+                for (auto& c : connections)
+                    shutdown(c.fd, SHUT_RDWR);
+                for (auto& c : connections) {
+                    c.thread.join();
+                    close(c.fd);
+                }
+                close(listener);
+                unlink(path.c_str());
+            }
+
+            /// @brief Indexes plots added to the store since the last scan and drops
+            /// the ones deleted, see PoRepT::rescan() (owning thread only)
+            RescanReport rescan() {
+                return porep.rescan();
+            }
+
+            /// @brief Number of challenges answered so far
+            size_t served() const {
+                return answered;
+            }
+
+        private:
+            struct Connection {
+                int fd;
+                std::thread thread;
+                std::atomic<bool> done{false};
+            };
+
+            /// @brief Accepts connections and reaps the closed ones
+            void accept_loop() {
+                pollfd p{listener, POLLIN, 0};
+                while (!stopping) {
+                    for (auto it = connections.begin(); it != connections.end();) {
+                        if (!it->done) {
+                            it++;
+                            continue;
+                        }
+                        it->thread.join();
+                        close(it->fd);
+                        it = connections.erase(it);
+                    }
+
+                    if (poll(&p, 1, 100) <= 0)
+                        continue;
+                    int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+                    if (fd < 0)
+                        continue;
+                    connections.emplace_back();
+                    Connection& c = connections.back();
+                    c.fd = fd;
+                    c.thread = std::thread(&ProverServerT::serve, this, &c);
+                }
+            }
+
+            /// @brief Answers the requests of one connection until it closes
+            void serve(Connection* c) {
+                const int fd = c->fd;
+                const size_t proof_size = Proof::n * sizeof(Hash);
+                uint8_t header[protocol::HEADER];
+                std::vector<uint8_t> challenges, response;
+                while (protocol::read_full(fd, header, sizeof(header))) {
+                    uint32_t count = protocol::load_count(header);
+                    if ((header[0] != protocol::PROVE && header[0] != protocol::PROVE_BATCH) ||
+                        (header[0] == protocol::PROVE && count != 1) || count > protocol::MAX_BATCH) {
+                        fail(fd, "Invalid request");
+                        break;
+                    }
+
+                    challenges.resize(count * sizeof(Hash));
+                    if (!protocol::read_full(fd, challenges.data(), challenges.size()))
+                        break;
+
+                    response.resize(protocol::HEADER + count * proof_size);
+                    protocol::store_header(protocol::OK, count, response.data());
+                    try {
+                        uint8_t* out = response.data() + protocol::HEADER;
+                        for (uint32_t i = 0; i < count; i++) {
+                            Proof proof = porep.generate_proof(Hash(challenges.data() + i * sizeof(Hash)));
+                            for (const Hash& h : proof.hashes)
+                                out = std::copy(h.bytes, h.bytes + sizeof(Hash), out);
+                        }
+                    }
+                    catch (const std::exception& e) {
+                        if (!fail(fd, e.what()))
+                            break;
+                        continue;
+                    }
+                    if (!protocol::write_full(fd, response.data(), response.size()))
+                        break;
+                    answered += count;
+                }
+                // The acceptor closes the descriptor, so it is never reused while in the list
+                c->done = true;
+            }
+
+            bool fail(int fd, const std::string& message) {
+                std::vector<uint8_t> response(protocol::HEADER + message.size());
+                protocol::store_header(protocol::ERROR, message.size(), response.data());
+                std::copy(message.begin(), message.end(), response.begin() + protocol::HEADER);
+                return protocol::write_full(fd, response.data(), response.size());
+            }
+
+            PoRep& porep;
+            std::string path;
+            int listener;
+            std::atomic<bool> stopping{false};
+            std::atomic<size_t> answered{0};
+            /// @brief Live connections, only touched by the acceptor and the destructor
+            std::list<Connection> connections;
+            std::thread acceptor;
+    };
+
+    /// @brief Blocking client of ProverServerT
+    /// @tparam PoRep The PoRepT instantiation the server runs
+    template <class PoRep>
+    class ProverClientT {
+        public:
+            typedef typename PoRep::Hash Hash;
+            typedef typename PoRep::Proof Proof;
+
+            /// @brief Connects to the daemon listening on @p path
+            ProverClientT(const std::string& path) {
+                sockaddr_un addr = protocol::address(path);
+                fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+                    if (fd >= 0)
+                        close(fd);
+                    throw std::runtime_error("Cannot connect to " + path);
+                }
+            }
+
+            ProverClientT(const ProverClientT&) = delete;
+            ProverClientT& operator=(const ProverClientT&) = delete;
+
+            ~ProverClientT() {
+                close(fd);
+            }
+
+            /// @brief Proves a single challenge
+            Proof prove(const Hash& challenge) {
+                return std::move(request(protocol::PROVE, &challenge, 1).front());
+            }
+
+            /// @brief Proves a batch of challenges in one round trip
+            std::vector<Proof> prove(const std::vector<Hash>& challenges) {
+                return request(protocol::PROVE_BATCH, challenges.data(), challenges.size());
+            }
+
+        private:
+            std::vector<Proof> request(uint8_t type, const Hash* challenges, size_t count) {
+                if (count > protocol::MAX_BATCH)
+                    throw std::runtime_error("Batch too large");
+                if (count == 0)
+                    return {};
+
+                std::vector<uint8_t> buffer(protocol::HEADER + count * sizeof(Hash));
+                protocol::store_header(type, count, buffer.data());
+                for (size_t i = 0; i < count; i++)
+                    std::copy(challenges[i].bytes, challenges[i].bytes + sizeof(Hash), buffer.data() + protocol::HEADER + i * sizeof(Hash));
+                if (!protocol::write_full(fd, buffer.data(), buffer.size()))
+                    throw std::runtime_error("Prover connection lost");
+
+                uint8_t header[protocol::HEADER];
+                if (!protocol::read_full(fd, header, sizeof(header)))
+                    throw std::runtime_error("Prover connection lost");
+                uint32_t n = protocol::load_count(header);
+                if (header[0] != protocol::OK) {
+                    std::string message(n, '\0');
+                    protocol::read_full(fd, &message[0], n);
+                    throw std::runtime_error("Prover error: " + message);
+                }
+                if (n != count)
+                    throw std::runtime_error("Prover answered " + std::to_string(n) + " of " + std::to_string(count) + " challenges");
+
+                std::vector<Proof> proofs(count);
+                buffer.resize(count * Proof::n * sizeof(Hash));
+                if (!protocol::read_full(fd, buffer.data(), buffer.size()))
+                    throw std::runtime_error("Prover connection lost");
+                const uint8_t* in = buffer.data();
+                for (Proof& proof : proofs) {
+                    for (size_t i = 0; i < Proof::n; i++, in += sizeof(Hash))
+                        proof.hashes.push_back(Hash(in));
+                }
+                return proofs;
+            }
+
+            int fd;
+    };
+}
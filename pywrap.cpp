@@ -1,11 +1,220 @@
 #include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
 #include "por.cpp"
+#include "binding.hpp"
 using namespace por;
 namespace py = pybind11;
 constexpr auto byref = py::return_value_policy::reference_internal;
 
+typedef PoRepSession<PoRep> Session;
+typedef PoRep::Hash Hash;
+typedef PoRep::Proof Proof;
+typedef AsyncProverT<PoRep> AsyncProver;
+
+/// @brief Reads a challenge given as a hex string or as raw bytes
+static Hash to_hash(const py::object& o) {
+    if (py::isinstance<py::str>(o))
+        return Hash(o.cast<std::string>());
+    std::string bytes = o.cast<py::bytes>();
+    if (bytes.size() != sizeof(Hash))
+        throw py::value_error("A challenge is " + std::to_string(sizeof(Hash)) + " bytes or a hex string");
+    return Hash(reinterpret_cast<const uint8_t*>(bytes.data()));
+}
+
+static std::vector<Hash> to_hashes(const py::iterable& challenges) {
+    std::vector<Hash> hashes;
+    for (const auto& c : challenges)
+        hashes.push_back(to_hash(py::reinterpret_borrow<py::object>(c)));
+    return hashes;
+}
+
+static py::bytes to_bytes(const Hash& h) {
+    return py::bytes(reinterpret_cast<const char*>(h.bytes), sizeof(Hash));
+}
+
+/// @brief A C-contiguous view of a buffer such as bytes or a NumPy array
+static std::shared_ptr<py::buffer_info> contiguous(const py::buffer& b) {
+    auto info = std::make_shared<py::buffer_info>(b.request());
+    py::ssize_t stride = info->itemsize;
+    for (py::ssize_t i = info->ndim - 1; i >= 0; i--) {
+        if (info->shape[i] > 1 && info->strides[i] != stride)
+            throw py::value_error("Plotting needs a contiguous buffer");
+        stride *= info->shape[i];
+    }
+    return info;
+}
+
+/// @brief Hands a task over to Python
+///
+/// Dropping a task that is still plotting waits for it with the GIL
+/// released, so other Python threads keep running; the GIL is taken back
+/// before the task goes, since it may hold the last reference to a buffer.
+static std::shared_ptr<PlotTask> to_python(std::unique_ptr<PlotTask> task) {
+    return std::shared_ptr<PlotTask>(task.release(), [](PlotTask* t) {
+        {
+            py::gil_scoped_release release;
+            t->wait();
+        }
+        delete t;
+    });
+}
+
+static std::string to_path(const py::object& path) {
+    return py::str(py::module_::import("os").attr("fspath")(path));
+}
+
 PYBIND11_MODULE(por_binding, m) {
-    m.doc() = "pybind11 example plugin"; // optional module docstring
+    m.doc() = "Proof of replication: plotting, proving and verification";
+
+    m.def("verify", &verify, "A function that verifies a proof given a challenge",
+          py::call_guard<py::gil_scoped_release>());
+
+    m.def("trace_start", [](size_t capacity) { Tracer::instance().start(capacity); }, py::arg("capacity") = 1 << 16,
+          "Starts recording plot and proof stages, keeping the latest capacity events per thread");
+    m.def("trace_stop", []() { Tracer::instance().stop(); });
+    m.def("trace_dump", [](const std::string& path) { Tracer::instance().dump(path); }, py::arg("path"),
+          "Writes the recorded stages as a Chrome trace", py::call_guard<py::gil_scoped_release>());
+
+    py::enum_<merkle::Layout>(m, "Layout")
+        .value("level", merkle::Layout::level)
+        .value("blocked", merkle::Layout::blocked);
+
+    py::class_<PlotConfig>(m, "PlotConfig")
+        .def(py::init<>())
+        .def_readwrite("plot_dir", &PlotConfig::plot_dir)
+        .def_readwrite("leaves_only", &PlotConfig::leaves_only)
+        .def_readwrite("top_levels", &PlotConfig::top_levels)
+        .def_readwrite("huge_pages", &PlotConfig::huge_pages)
+        .def_readwrite("cache_levels", &PlotConfig::cache_levels)
+        .def_readwrite("cache_budget", &PlotConfig::cache_budget)
+        .def_readwrite("layout", &PlotConfig::layout)
+        .def_readwrite("block_size", &PlotConfig::block_size)
+        .def_readwrite("index_batch", &PlotConfig::index_batch)
+        .def_readwrite("index_delay", &PlotConfig::index_delay)
+        .def_readwrite("checkpoint_interval", &PlotConfig::checkpoint_interval)
+        .def_readwrite("manifest", &PlotConfig::manifest)
+        .def_readwrite("segment_records", &PlotConfig::segment_records)
+        .def_readwrite("compaction_rate", &PlotConfig::compaction_rate)
+        .def_readwrite("compact_index", &PlotConfig::compact_index)
+        .def_property("encryption_key",
+            [](const PlotConfig& c) { return py::bytes(reinterpret_cast<const char*>(c.encryption_key.data()), c.encryption_key.size()); },
+            [](PlotConfig& c, const py::bytes& key) { std::string k = key; c.encryption_key.assign(k.begin(), k.end()); })
+        .def_property("encryption_iv",
+            [](const PlotConfig& c) { return py::bytes(reinterpret_cast<const char*>(c.encryption_iv.data()), c.encryption_iv.size()); },
+            [](PlotConfig& c, const py::bytes& iv) { std::string v = iv; c.encryption_iv.assign(v.begin(), v.end()); });
+
+    py::class_<Proof>(m, "Proof")
+        .def(py::init<const std::string&>(), py::arg("hex"))
+        .def("to_string", &Proof::to_string)
+        .def("__str__", &Proof::to_string)
+        .def_property_readonly("hashes", [](const Proof& p) {
+            py::list hashes;
+            for (const Hash& h : p.hashes)
+                hashes.append(to_bytes(h));
+            return hashes;
+        })
+        .def_property_readonly("root", [](Proof& p) { return to_bytes(p.root()); })
+        .def("quality", [](const Proof& p, const py::object& challenge) { return p.quality(to_hash(challenge)); });
+
+    py::class_<PlotTask, std::shared_ptr<PlotTask>>(m, "PlotTask", "Handle of a background plot call")
+        .def("done", &PlotTask::done)
+        .def("progress", &PlotTask::chunks, "(chunks plotted, chunks in total)")
+        .def("wait", &PlotTask::wait, py::arg("timeout") = -1.0, py::call_guard<py::gil_scoped_release>(),
+             "Waits up to timeout seconds, forever if negative; returns whether plotting has finished")
+        .def("result", &PlotTask::result, py::call_guard<py::gil_scoped_release>(),
+             "Waits for plotting and raises its error, if any, else returns the salt of the encryption IV");
+
+    py::class_<Session>(m, "PoRep")
+        .def(py::init<const PlotConfig&>(), py::arg("config") = PlotConfig())
+        .def_property_readonly("config", &Session::config, byref)
+        .def("plot", [](Session& s, const py::buffer& data) {
+            auto info = contiguous(data);
+            py::gil_scoped_release release;
+            return s.plot(static_cast<const uint8_t*>(info->ptr), info->size * info->itemsize);
+        }, py::arg("data"), "Plots bytes or a contiguous array, returning the salt of the encryption IV (0 without encryption)")
+        .def("plot", [](Session& s, const py::object& path) {
+            std::string p = to_path(path);
+            py::gil_scoped_release release;
+            return s.plot(p);
+        }, py::arg("path"), "Plots a file, returning the salt of the encryption IV, also kept in plot_dir")
+        .def("plot_many", [](Session& s, const std::vector<std::string>& paths, size_t threads) {
+            py::gil_scoped_release release;
+            return s.plot(paths, threads);
+        }, py::arg("paths"), py::arg("threads") = 0, "Plots several files with a shared pool of workers, returning the salt of the encryption IV")
+        .def("replot", [](Session& s, const py::object& path) {
+            std::string p = to_path(path);
+            py::gil_scoped_release release;
+            s.replot(p);
+        }, py::arg("path"))
+        .def("plot_async", [](Session& s, const py::buffer& data) {
+            auto info = contiguous(data);
+            // The buffer is released by the task once plotting is over, with the GIL held
+            return to_python(s.plot_async(static_cast<const uint8_t*>(info->ptr), info->size * info->itemsize, info));
+        }, py::arg("data"), py::keep_alive<0, 1>())
+        .def("plot_async", [](Session& s, const py::object& path) {
+            return to_python(s.plot_async(to_path(path)));
+        }, py::arg("path"), py::keep_alive<0, 1>())
+        .def("load_plot", &Session::load_plot, py::arg("path") = "", py::call_guard<py::gil_scoped_release>())
+        .def("generate_proof", [](Session& s, const py::object& challenge) {
+            Hash c = to_hash(challenge);
+            py::gil_scoped_release release;
+            return s.generate_proof(c);
+        }, py::arg("challenge"))
+        .def("generate_proofs", [](Session& s, const py::iterable& challenges, size_t threads) {
+            std::vector<Hash> c = to_hashes(challenges);
+            py::gil_scoped_release release;
+            return s.generate_proofs(c, threads);
+        }, py::arg("challenges"), py::arg("threads") = 0)
+        .def("verify", [](Session& s, const Proof& proof, const py::object& challenge) {
+            Hash c = to_hash(challenge);
+            py::gil_scoped_release release;
+            return s.verify(proof, c);
+        }, py::arg("proof"), py::arg("challenge"))
+        .def("metrics", [](const Session& s) {
+            auto metrics = s.metrics();
+            py::dict d;
+            d["plots"] = metrics.plots;
+            d["conflicts"] = metrics.conflicts;
+            d["roots"] = metrics.roots;
+            d["chunks_done"] = metrics.chunks_done;
+            d["chunks_total"] = metrics.chunks_total;
+            return d;
+        });
 
-    m.def("verify", &verify, "A function that verifies a proof given a challenge");
-}
\ No newline at end of file
+    py::class_<AsyncProver>(m, "AsyncProver", "Thread pool for event loops, see por_async.py")
+        .def(py::init<Session&, size_t>(), py::arg("porep"), py::arg("threads") = 0, py::keep_alive<1, 2>())
+        .def("fd", &AsyncProver::fd, "Descriptor readable once operations have finished")
+        .def("submit_proofs", [](AsyncProver& a, const py::iterable& challenges) {
+            return a.submit_proofs(to_hashes(challenges));
+        }, py::arg("challenges"), "Queues a batch of proofs, returning its ticket")
+        .def("submit_verify", [](AsyncProver& a, const std::vector<Proof>& proofs, const py::iterable& challenges) {
+            return a.submit_verify(proofs, to_hashes(challenges));
+        }, py::arg("proofs"), py::arg("challenges"), "Queues a batch of verifications, returning its ticket")
+        .def("poll", [](AsyncProver& a) {
+            py::list done;
+            for (const auto& op : a.poll()) {
+                py::object error = py::none(), results;
+                if (op->error) {
+                    try {
+                        std::rethrow_exception(op->error);
+                    }
+                    catch (const std::exception& e) {
+                        error = py::str(e.what());
+                    }
+                    catch (...) {
+                        error = py::str("unknown error");
+                    }
+                }
+                else if (op->verifying) {
+                    py::list valid;
+                    for (uint8_t v : op->valid)
+                        valid.append(py::bool_(v != 0));
+                    results = valid;
+                }
+                else
+                    results = py::cast(op->proofs);
+                done.append(py::make_tuple(op->ticket, error, results));
+            }
+            return done;
+        }, "Takes the finished operations as (ticket, error or None, results) tuples");
+}
@@ -0,0 +1,347 @@
+#pragma once
+
+#include "por.hpp"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <set>
+
+namespace por {
+
+    /// @brief Thread running tasks one at a time, urgent ones first, each kind in submission order
+    class IoWorker {
+        public:
+            IoWorker() : thread(&IoWorker::run, this) {}
+
+            IoWorker(const IoWorker&) = delete;
+            IoWorker& operator=(const IoWorker&) = delete;
+
+            /// @brief Finishes the queued tasks and stops
+            ~IoWorker() {
+                {
+                    std::lock_guard<std::mutex> lock(m);
+                    stopping = true;
+                }
+                cv.notify_one();
+                thread.join();
+            }
+
+            /// @brief Queues @p f
+            /// @param urgent Run @p f before every queued task that is not urgent
+            /// @return Future of the result, rethrowing what @p f throws
+            template <class F>
+            auto submit(F f, bool urgent = false) -> std::future<decltype(f())> {
+                auto task = std::make_shared<std::packaged_task<decltype(f())()>>(std::move(f));
+                auto result = task->get_future();
+                {
+                    std::lock_guard<std::mutex> lock(m);
+                    (urgent ? urgent_tasks : tasks).push_back([task]() { (*task)(); });
+                }
+                cv.notify_one();
+                return result;
+            }
+
+        private:
+            void run() {
+                std::unique_lock<std::mutex> lock(m);
+                while (true) {
+                    cv.wait(lock, [this]() { return stopping || !urgent_tasks.empty() || !tasks.empty(); });
+                    std::deque<std::function<void()>>& queue = urgent_tasks.empty() ? tasks : urgent_tasks;
+                    if (queue.empty())
+                        return;
+                    std::function<void()> task = std::move(queue.front());
+                    queue.pop_front();
+                    lock.unlock();
+                    task();
+                    lock.lock();
+                }
+            }
+
+            std::mutex m;
+            std::condition_variable cv;
+            std::deque<std::function<void()>> tasks;
+            /// @brief Tasks run before those of @p tasks, e.g. proofs waiting behind plot writes
+            std::deque<std::function<void()>> urgent_tasks;
+            bool stopping = false;
+            std::thread thread;
+    };
+
+    /// @brief Plot store spread over several directories, typically one per disk
+    ///
+    /// Every shard is a PoRepT with its own root index and an I/O worker that
+    /// does all its plotting and proving, so disks work in parallel; proofs
+    /// jump the queue of plot writes. Challenges are looked up in every
+    /// shard and proven by the shard holding the globally closest root, from
+    /// the snapshot the lookup used. Plotting sends each chunk to the shard
+    /// with the most free space among those keeping up with their queue, so
+    /// faster disks take more chunks. A root already stored by any shard is
+    /// a conflict.
+    /// @tparam PoRep The PoRepT instantiation of the shards
+    template <class PoRep>
+    class ShardedPoRepT {
+        public:
+            typedef typename PoRep::Hash Hash;
+            typedef typename PoRep::Proof Proof;
+            typedef typename PoRep::Workspace Workspace;
+
+            /// @brief Chunks queued per shard before plotting waits for it
+            static constexpr size_t QUEUE_DEPTH = 8;
+
+            /// @brief Constructs the shards
+            /// @param config Settings shared by all shards, except for plot_dir
+            /// @param plot_dirs One plot directory per shard
+            ShardedPoRepT(const PlotConfig& config, const std::vector<std::string>& plot_dirs) {
+                if (plot_dirs.empty())
+                    throw std::runtime_error("A sharded plot store needs at least one directory");
+                for (const std::string& dir : plot_dirs) {
+                    PlotConfig c = config;
+                    c.plot_dir = dir;
+                    fs::create_directories(dir);
+                    shards.emplace_back(new Shard(c));
+                }
+            }
+
+            /// @brief Indexes the plots of every shard, all shards in parallel
+            void load_plot() {
+                std::vector<std::future<void>> done;
+                for (auto& s : shards)
+                    done.push_back(s->worker.submit([&s]() { s->porep.load_plot(s->porep.config.plot_dir); }));
+                for (auto& d : done)
+                    d.get();
+            }
+
+            /// @brief Plots a file across the shards
+            /// @return Salt of the encryption IV, also kept in the input's
+            /// .salt sidecar in every shard; 0 without encryption
+            ///
+            /// Checkpoints and manifests are per directory and not supported here.
+            uint64_t plot(char* filename) {
+                const PlotConfig& config = shards[0]->porep.config;
+                if (config.checkpoint_interval > 0 || config.manifest)
+                    throw std::runtime_error("Sharded plotting does not support checkpoints or manifests");
+
+                std::ifstream f(filename, std::ifstream::binary);
+                if (!f.good())
+                    throw std::runtime_error("Cannot plot from invalid file");
+
+                // Each shard reads chunks into a ring of workspaces; a slot is
+                // reused once the task QUEUE_DEPTH submissions back is done
+                uint64_t salt = shards[0]->porep.new_salt();
+                for (auto& s : shards)
+                    s->porep.save_salt(filename, salt);
+                std::vector<std::vector<std::unique_ptr<Workspace>>> ring(shards.size());
+                for (auto& r : ring) {
+                    for (size_t i = 0; i < QUEUE_DEPTH; i++)
+                        r.emplace_back(new Workspace(config, salt));
+                }
+                std::vector<size_t> submitted(shards.size(), 0);
+                std::vector<std::deque<std::future<void>>> queued(shards.size());
+                std::vector<size_t> space(shards.size());
+                try {
+                    uint64_t offset = 0;
+                    while (true)
+                    {
+                        if (offset % 256 == 0) {
+                            for (size_t i = 0; i < shards.size(); i++)
+                                space[i] = fs::space(shards[i]->porep.config.plot_dir).available;
+                        }
+
+                        // Most free space among the shards keeping up, else wait for the roomiest
+                        size_t best = shards.size(), roomiest = 0;
+                        for (size_t i = 0; i < shards.size(); i++) {
+                            while (!queued[i].empty() && queued[i].front().wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+                                reap(queued[i]);
+                            if (space[i] > space[roomiest])
+                                roomiest = i;
+                            if (queued[i].size() < QUEUE_DEPTH && (best == shards.size() || space[i] > space[best]))
+                                best = i;
+                        }
+                        if (best == shards.size()) {
+                            best = roomiest;
+                            reap(queued[best]);
+                        }
+
+                        Shard* s = shards[best].get();
+                        Workspace* ws = ring[best][submitted[best] % QUEUE_DEPTH].get();
+                        if (!s->porep.read_chunk(f, *ws, offset))
+                            break;
+                        queued[best].push_back(s->worker.submit([this, s, ws, offset]() { plot_chunk(*s, *ws, offset); }));
+                        submitted[best]++;
+                        space[best] -= std::min(space[best], s->porep.plot_file_size());
+                        offset++;
+                    }
+                    for (auto& q : queued)
+                        while (!q.empty())
+                            reap(q);
+                }
+                catch (...) {
+                    // Queued tasks still use the ring
+                    for (auto& q : queued)
+                        for (auto& task : q)
+                            task.wait();
+                    // Plots stored before the failure are complete and stay
+                    end_run();
+                    throw;
+                }
+                f.close();
+                end_run();
+                return salt;
+            }
+
+            /// @brief Proves a challenge from the globally closest root
+            /// @param challenge
+            ///
+            /// Safe to call from any thread, also while plotting.
+            Proof generate_proof(const Hash& challenge) {
+                return submit_proof(challenge).get();
+            }
+
+            /// @brief Proves a batch of challenges, each shard reading its share in parallel
+            std::vector<Proof> generate_proofs(const std::vector<Hash>& challenges) {
+                std::vector<std::future<Proof>> pending;
+                pending.reserve(challenges.size());
+                for (const Hash& challenge : challenges)
+                    pending.push_back(submit_proof(challenge));
+                std::vector<Proof> proofs;
+                proofs.reserve(challenges.size());
+                for (auto& p : pending)
+                    proofs.push_back(p.get());
+                return proofs;
+            }
+
+            bool verify(Proof p, Hash challenge) {
+                return shards[0]->porep.verify(p, challenge);
+            }
+
+            /// @brief Number of shards
+            size_t size() const {
+                return shards.size();
+            }
+
+            /// @brief The prover of shard @p i
+            PoRep& shard(size_t i) {
+                return shards.at(i)->porep;
+            }
+
+            int get_plots() {
+                int n = 0;
+                for (auto& s : shards)
+                    n += s->porep.get_plots();
+                return n;
+            }
+
+            int get_conflicts() {
+                int n = 0;
+                for (auto& s : shards)
+                    n += s->porep.get_conflicts();
+                return n;
+            }
+
+        private:
+            typedef typename PoRep::RootIndex::Snapshot Snapshot;
+            typedef typename PoRep::RootIndex::Entry Entry;
+
+            struct Shard {
+                Shard(const PlotConfig& config) : porep(config) {}
+
+                PoRep porep;
+                /// @brief Declared last so it stops before the rest is destroyed
+                IoWorker worker;
+            };
+
+            /// @brief The globally closest root and the snapshot it was found in
+            struct Closest {
+                Shard* shard = nullptr;
+                std::shared_ptr<const Snapshot> snapshot;
+                const Entry* entry = nullptr;
+            };
+
+            /// @brief Looks up the root closest to @p challenge, ties going to the smaller root
+            Closest closest(const Hash& challenge) const {
+                Closest best;
+                Hash best_distance;
+                for (const auto& s : shards) {
+                    auto snapshot = s->porep.search.snapshot();
+                    auto entry = snapshot->closest(challenge);
+                    if (entry == nullptr)
+                        continue;
+                    Hash distance = entry->root.distance(challenge);
+                    if (best.entry == nullptr || distance < best_distance ||
+                        (distance == best_distance && entry->root < best.entry->root)) {
+                        best.shard = s.get();
+                        best.snapshot = std::move(snapshot);
+                        best.entry = entry;
+                        best_distance = distance;
+                    }
+                }
+                if (best.entry == nullptr)
+                    throw std::runtime_error("No plots to prove from");
+                return best;
+            }
+
+            /// @brief Queues the proof of @p challenge ahead of the plot writes of its shard
+            std::future<Proof> submit_proof(const Hash& challenge) {
+                Closest c = closest(challenge);
+                return c.shard->worker.submit([c, challenge]() { return c.shard->porep.generate_proof(challenge, *c.entry); }, true);
+            }
+
+            /// @brief Encodes and stores the chunk read into @p ws on shard @p s (worker of @p s only)
+            ///
+            /// A root any shard has indexed, or another worker has claimed
+            /// during this run, is a conflict.
+            void plot_chunk(Shard& s, Workspace& ws, uint64_t offset) {
+                s.porep.build_chunk(ws, offset);
+                s.porep.encode_chunk(ws);
+                Hash root = ws.tree.root();
+                bool stored = s.porep.search.contains(root);
+                for (const auto& other : shards)
+                    stored = stored || (other.get() != &s && other->porep.search.snapshot()->find(root) != nullptr);
+                {
+                    std::lock_guard<std::mutex> lock(claimed_mutex);
+                    if (stored || !claimed.insert(root).second) {
+                        s.porep.conflicts++;
+                        return;
+                    }
+                }
+                try {
+                    s.porep.store_chunk(ws);
+                }
+                catch (...) {
+                    // Not stored, so a later run may plot it
+                    std::lock_guard<std::mutex> lock(claimed_mutex);
+                    claimed.erase(root);
+                    throw;
+                }
+                s.porep.index_chunk(ws.tree);
+                s.porep.search.maybe_publish();
+                s.porep.plots++;
+            }
+
+            /// @brief Publishes the roots every shard indexed during a plot call and drops its claims
+            ///
+            /// Until published, a root is only known to the other shards
+            /// through @p claimed, so the claims go only after the publish.
+            void end_run() {
+                std::vector<std::future<void>> done;
+                for (auto& s : shards)
+                    done.push_back(s->worker.submit([&s]() { s->porep.search.publish(); }));
+                for (auto& d : done)
+                    d.get();
+                std::lock_guard<std::mutex> lock(claimed_mutex);
+                claimed.clear();
+            }
+
+            /// @brief Waits for the oldest task of a queue, rethrowing its error
+            static void reap(std::deque<std::future<void>>& queue) {
+                std::future<void> oldest = std::move(queue.front());
+                queue.pop_front();
+                oldest.get();
+            }
+
+            std::vector<std::unique_ptr<Shard>> shards;
+            /// @brief Roots plotted by the running plot call, on any shard
+            std::set<Hash> claimed;
+            std::mutex claimed_mutex;
+    };
+}
@@ -1,3 +1,252 @@
-from por_binding import verify
-if __name__ ==  "__main__":
-    print(verify("3b9d89bc8ae0c8b0c28ea6616151ce07c140f4ac7286b379736c7935d857a80d7c9189f2b1dad9f1eebcb66e2e3ce425fd6fde9e52f4dc4348464f04a65aa95518f4efd2ee85ae909dd1e931241f8d4b9e03abfa37d4e0303c22266ad274c16b643adbb06a68d1dd3d399b20853ceca318136837a7aa92d1da81c52d4b0342b9a9b1aad77595d9bff2491464c9c4212d6967cafb3eb58029376d703721aaf31b94c3419f8f11288bb312095346a5a5ea9b6e65545f20d314f4c1ca68f4440f7d5c4cc26de15f156b217fc94d292f3a24692ae36f654555fc09ee6e7270b9153e0e0c8761f9891a28d4673988434d3ceaaded9002e89aad2267f5f7b879be4cee", "0000000000000000000000000000000000000000000000000000000000000000"))
+"""Tests of por_binding and por_async.
+
+The AsyncProver tests run against a stand-in for por_binding.AsyncProver
+that signals through an eventfd like the C++ pool, so the wakeup,
+cancellation and shutdown paths of por_async run even without the
+module; with por_binding built, everything also runs end to end.
+"""
+import asyncio
+import contextlib
+import os
+import sys
+import tempfile
+import threading
+import time
+import types
+
+try:
+    import por_binding
+except ImportError:
+    por_binding = None
+    sys.modules["por_binding"] = types.ModuleType("por_binding")
+
+import por_async
+
+
+class FakePool:
+    """Stand-in for por_binding.AsyncProver: a "proof" of c is "proof-" + c.
+
+    Operations finish on their own thread once gate is set; the challenge
+    "bad" fails its batch.
+    """
+
+    gate = threading.Event()
+
+    def __init__(self, porep, threads=0):
+        self._fd = os.eventfd(0, os.EFD_NONBLOCK | os.EFD_CLOEXEC)
+        self._lock = threading.Lock()
+        self._done = []
+        self._next = 0
+
+    def fd(self):
+        return self._fd
+
+    def submit_proofs(self, challenges):
+        challenges = list(challenges)
+        return self._submit(lambda: [self._prove(c) for c in challenges])
+
+    def submit_verify(self, proofs, challenges):
+        pairs = list(zip(proofs, challenges))
+        return self._submit(lambda: [p == "proof-" + c for p, c in pairs])
+
+    def poll(self):
+        with contextlib.suppress(BlockingIOError):
+            os.eventfd_read(self._fd)
+        with self._lock:
+            done, self._done = self._done, []
+        return done
+
+    @staticmethod
+    def _prove(challenge):
+        if challenge == "bad":
+            raise ValueError("invalid challenge")
+        return "proof-" + challenge
+
+    def _submit(self, work):
+        with self._lock:
+            ticket = self._next
+            self._next += 1
+        threading.Thread(target=self._run, args=(ticket, work), daemon=True).start()
+        return ticket
+
+    def _run(self, ticket, work):
+        self.gate.wait()
+        try:
+            result = (ticket, None, work())
+        except ValueError as e:
+            result = (ticket, str(e), None)
+        with self._lock:
+            self._done.append(result)
+        os.eventfd_write(self._fd, 1)
+
+
+@contextlib.contextmanager
+def fake_pool(open_gate=True):
+    real = getattr(por_async.por_binding, "AsyncProver", None)
+    por_async.por_binding.AsyncProver = FakePool
+    if open_gate:
+        FakePool.gate.set()
+    else:
+        FakePool.gate.clear()
+    try:
+        yield
+    finally:
+        FakePool.gate.set()
+        if real is None:
+            del por_async.por_binding.AsyncProver
+        else:
+            por_async.por_binding.AsyncProver = real
+
+
+def run(test):
+    """Runs the coroutine function test, failing on errors the loop only logs."""
+    errors = []
+
+    async def main():
+        asyncio.get_running_loop().set_exception_handler(lambda loop, context: errors.append(context))
+        await asyncio.wait_for(test(), 30)
+
+    asyncio.run(main())
+    assert not errors, errors
+    print("ok   %s" % test.__name__)
+
+
+async def async_wakeup():
+    with fake_pool():
+        prover = por_async.AsyncProver(None)
+        challenges = [["c%d-%d" % (k, i) for i in range(k % 5)] for k in range(50)]
+        results = await asyncio.gather(*(prover.generate_proofs(c) for c in challenges))
+        for c, proofs in zip(challenges, results):
+            assert proofs == ["proof-" + x for x in c]
+            assert await prover.verify(proofs, c) == [True] * len(c)
+        assert await prover.generate_proof("single") == "proof-single"
+        assert not prover._pending
+        prover.close()
+
+
+async def async_error():
+    with fake_pool():
+        prover = por_async.AsyncProver(None)
+        good = prover.generate_proofs(["a"])
+        try:
+            await prover.generate_proofs(["a", "bad"])
+            assert False, "an error was expected"
+        except RuntimeError as e:
+            assert "invalid challenge" in str(e)
+        assert await good == ["proof-a"]
+        prover.close()
+
+
+async def async_cancellation():
+    with fake_pool(open_gate=False):
+        prover = por_async.AsyncProver(None)
+        cancelled = prover.generate_proofs(["a"])
+        kept = prover.generate_proofs(["b"])
+        cancelled.cancel()
+        try:
+            await asyncio.wait_for(prover.generate_proof("c"), 0.05)
+            assert False, "a timeout was expected"
+        except asyncio.TimeoutError:
+            pass
+
+        # Results of cancelled operations arrive later and are dropped
+        FakePool.gate.set()
+        assert await kept == ["proof-b"]
+        while prover._pending:
+            await asyncio.sleep(0.01)
+        assert cancelled.cancelled()
+        prover.close()
+
+
+async def async_shutdown():
+    loop = asyncio.get_running_loop()
+    with fake_pool(open_gate=False):
+        prover = por_async.AsyncProver(None)
+        futures = [prover.generate_proofs(["a"]), prover.verify(["proof-a"], ["a"])]
+        prover.close()
+        assert all(f.cancelled() for f in futures)
+        assert not prover._pending
+        # The eventfd is no longer watched, so late results do not wake the loop
+        assert not loop.remove_reader(prover._pool.fd())
+        try:
+            prover.generate_proofs(["b"])
+            assert False, "closed provers should reject new calls"
+        except RuntimeError:
+            pass
+        prover.close()
+        FakePool.gate.set()
+        await asyncio.sleep(0.05)
+        assert all(f.cancelled() for f in futures)
+
+
+def binding():
+    assert por_binding.verify("3b9d89bc8ae0c8b0c28ea6616151ce07c140f4ac7286b379736c7935d857a80d7c9189f2b1dad9f1eebcb66e2e3ce425fd6fde9e52f4dc4348464f04a65aa95518f4efd2ee85ae909dd1e931241f8d4b9e03abfa37d4e0303c22266ad274c16b643adbb06a68d1dd3d399b20853ceca318136837a7aa92d1da81c52d4b0342b9a9b1aad77595d9bff2491464c9c4212d6967cafb3eb58029376d703721aaf31b94c3419f8f11288bb312095346a5a5ea9b6e65545f20d314f4c1ca68f4440f7d5c4cc26de15f156b217fc94d292f3a24692ae36f654555fc09ee6e7270b9153e0e0c8761f9891a28d4673988434d3ceaaded9002e89aad2267f5f7b879be4cee", "0000000000000000000000000000000000000000000000000000000000000000")
+
+    with tempfile.TemporaryDirectory() as plot_dir:
+        config = por_binding.PlotConfig()
+        config.plot_dir = plot_dir
+        p = por_binding.PoRep(config)
+        task = p.plot_async(os.urandom(64 * 2048))
+        while not task.wait(0.1):
+            print("plotted %d/%d chunks" % task.progress())
+        assert task.result() == 0  # the salt, 0 without encryption
+        print(p.metrics())
+
+        # Dropping a running task waits for it without holding up other threads
+        ticks = []
+        stop = threading.Event()
+
+        def tick():
+            while not stop.is_set():
+                ticks.append(1)
+                time.sleep(0.001)
+
+        ticker = threading.Thread(target=tick)
+        ticker.start()
+        task = p.plot_async(os.urandom(64 * 2048 * 256))
+        before = len(ticks)
+        del task
+        after = len(ticks)
+        stop.set()
+        ticker.join()
+        assert after > before + 5, "dropping a task blocked the other threads"
+
+        challenges = [os.urandom(32) for _ in range(16)]
+        proofs = p.generate_proofs(challenges)
+        assert all(p.verify(proof, c) for proof, c in zip(proofs, challenges))
+
+        async def async_binding():
+            prover = por_async.AsyncProver(p, 2)
+            batches = [[os.urandom(32) for _ in range(k % 4 + 1)] for k in range(20)]
+            results = await asyncio.gather(*(prover.generate_proofs(c) for c in batches))
+            for c, proofs in zip(batches, results):
+                assert all(await prover.verify(proofs, c))
+                assert [str(x) for x in proofs] == [str(x) for x in p.generate_proofs(c)]
+            prover.close()
+
+        run(async_binding)
+
+    with tempfile.TemporaryDirectory() as plot_dir:
+        config = por_binding.PlotConfig()
+        config.plot_dir = plot_dir
+
+        async def async_binding_error():
+            prover = por_async.AsyncProver(por_binding.PoRep(config))
+            try:
+                await prover.generate_proof(os.urandom(32))
+                assert False, "proving from an empty store should fail"
+            except RuntimeError:
+                pass
+            prover.close()
+
+        run(async_binding_error)
+    print("ok   binding")
+
+
+if __name__ == "__main__":
+    for test in (async_wakeup, async_error, async_cancellation, async_shutdown):
+        run(test)
+    if por_binding is None:
+        print("por_binding is not built, skipping its tests")
+    else:
+        binding()
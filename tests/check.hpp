@@ -0,0 +1,82 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/// @brief Fails the running test unless @p cond holds
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) \
+            throw std::runtime_error(std::string(__FILE__) + ":" + std::to_string(__LINE__) + ": " #cond); \
+    } while (0)
+
+namespace test {
+
+    /// @brief Fresh directory under the system temporary directory, removed on destruction
+    struct TempDir {
+        TempDir() {
+            std::string name = "por-test-XXXXXX";
+            std::string pattern = (fs::temp_directory_path() / name).string();
+            if (mkdtemp(&pattern[0]) == nullptr)
+                throw std::runtime_error("Cannot create a temporary directory");
+            path = pattern;
+        }
+
+        TempDir(const TempDir&) = delete;
+        TempDir& operator=(const TempDir&) = delete;
+
+        ~TempDir() {
+            std::error_code ec;
+            fs::remove_all(path, ec);
+        }
+
+        std::string operator/(const std::string& name) const {
+            return (path / name).string();
+        }
+
+        fs::path path;
+    };
+
+    /// @brief Pseudo-random bytes, the same for the same @p seed
+    inline std::vector<uint8_t> random_bytes(size_t size, uint64_t seed) {
+        std::mt19937_64 rng(seed);
+        std::vector<uint8_t> bytes(size);
+        for (auto& b : bytes)
+            b = rng();
+        return bytes;
+    }
+
+    inline void write_file(const std::string& path, const std::vector<uint8_t>& bytes) {
+        std::ofstream f(path, std::ofstream::binary | std::ofstream::trunc);
+        f.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        if (!f)
+            throw std::runtime_error("Cannot write " + path);
+    }
+
+    /// @brief Runs every test, reporting each one
+    /// @return The exit code, non-zero if any test failed
+    inline int run(const std::vector<std::pair<std::string, std::function<void()>>>& tests) {
+        int failed = 0;
+        for (const auto& t : tests) {
+            try {
+                t.second();
+                std::cout << "ok   " << t.first << std::endl;
+            }
+            catch (const std::exception& e) {
+                std::cout << "FAIL " << t.first << ": " << e.what() << std::endl;
+                failed++;
+            }
+        }
+        std::cout << tests.size() - failed << "/" << tests.size() << " passed" << std::endl;
+        return failed == 0 ? 0 : 1;
+    }
+}
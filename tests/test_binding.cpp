@@ -0,0 +1,127 @@
+#include "binding.hpp"
+#include "check.hpp"
+
+#include <poll.h>
+
+// The C++ side of por_binding: sessions, background plot tasks and the
+// eventfd driven prover pool behind por_async.AsyncProver.
+
+using namespace por;
+
+typedef PoRepSession<PoRep> Session;
+typedef AsyncProverT<PoRep> AsyncProver;
+
+static std::vector<PoRep::Hash> random_challenges(size_t count, uint64_t seed) {
+    std::vector<uint8_t> bytes = test::random_bytes(count * sizeof(PoRep::Hash), seed);
+    std::vector<PoRep::Hash> challenges;
+    for (size_t i = 0; i < count; i++)
+        challenges.push_back(PoRep::Hash(bytes.data() + i * sizeof(PoRep::Hash)));
+    return challenges;
+}
+
+/// @brief Waits for the pool to signal and takes the finished operations
+static std::vector<std::shared_ptr<AsyncProver::Operation>> wait_poll(AsyncProver& pool) {
+    pollfd p{pool.fd(), POLLIN, 0};
+    CHECK(::poll(&p, 1, 10000) == 1);
+    return pool.poll();
+}
+
+static void plot_task() {
+    test::TempDir dir;
+    PlotConfig config;
+    config.plot_dir = dir / "plot";
+    Session s(config);
+
+    auto data = std::make_shared<std::vector<uint8_t>>(test::random_bytes(32 * PoRep::CHUNK_SIZE, 1));
+    auto task = s.plot_async(data->data(), data->size(), data);
+    task->result();
+    CHECK(task->done());
+    CHECK(task->chunks() == std::make_pair(uint64_t(32), uint64_t(32)));
+    CHECK(s.metrics().plots + s.metrics().conflicts == 32);
+    CHECK(s.metrics().roots == size_t(s.metrics().plots));
+
+    auto challenges = random_challenges(64, 2);
+    auto proofs = s.generate_proofs(challenges, 4);
+    for (size_t i = 0; i < proofs.size(); i++) {
+        CHECK(proofs[i].to_string() == s.generate_proof(challenges[i]).to_string());
+        CHECK(s.verify(proofs[i], challenges[i]));
+    }
+}
+
+static void plot_task_error() {
+    test::TempDir dir;
+    PlotConfig config;
+    config.plot_dir = dir / "plot";
+    Session s(config);
+    auto task = s.plot_async(dir / "missing");
+    bool thrown = false;
+    try {
+        task->result();
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+static void async_prover() {
+    test::TempDir dir;
+    PlotConfig config;
+    config.plot_dir = dir / "plot";
+    Session s(config);
+    std::vector<uint8_t> data = test::random_bytes(16 * PoRep::CHUNK_SIZE, 3);
+    s.plot(data.data(), data.size());
+
+    AsyncProver pool(s, 3);
+    std::map<uint64_t, std::vector<PoRep::Hash>> sent;
+    for (size_t k = 0; k < 50; k++) {
+        auto challenges = random_challenges(k % 5, 100 + k);
+        sent[pool.submit_proofs(challenges)] = challenges;
+    }
+
+    std::map<uint64_t, size_t> verifying;
+    size_t proved = 0, verified = 0;
+    while (proved < sent.size() || !verifying.empty()) {
+        for (const auto& op : wait_poll(pool)) {
+            CHECK(!op->error);
+            if (op->verifying) {
+                for (uint8_t v : op->valid)
+                    verified += v;
+                CHECK(verifying.erase(op->ticket) == 1);
+                continue;
+            }
+            const auto& challenges = sent.at(op->ticket);
+            CHECK(op->proofs.size() == challenges.size());
+            for (size_t i = 0; i < challenges.size(); i++)
+                CHECK(op->proofs[i].to_string() == s.generate_proof(challenges[i]).to_string());
+            verifying[pool.submit_verify(op->proofs, challenges)] = challenges.size();
+            proved++;
+        }
+    }
+    size_t total = 0;
+    for (const auto& c : sent)
+        total += c.second.size();
+    CHECK(verified == total);
+}
+
+static void async_prover_error() {
+    test::TempDir dir;
+    PlotConfig config;
+    config.plot_dir = dir / "plot";
+    Session s(config);
+    AsyncProver pool(s, 2);
+    uint64_t ticket = pool.submit_proofs(random_challenges(3, 4));
+    auto done = wait_poll(pool);
+    CHECK(done.size() == 1);
+    CHECK(done[0]->ticket == ticket);
+    CHECK(done[0]->error);
+}
+
+int main() {
+    return test::run({
+        {"plot_task", plot_task},
+        {"plot_task_error", plot_task_error},
+        {"async_prover", async_prover},
+        {"async_prover_error", async_prover_error},
+    });
+}
@@ -0,0 +1,136 @@
+#include "geometry.hpp"
+#include "check.hpp"
+
+#include <set>
+
+// Geometries picked at runtime: every supported one plots and proves
+// through make_porep(), challenges reach every leaf of large trees, and the
+// encoding chains every proof node to a node of the same proof.
+
+using namespace por;
+
+typedef DynamicPoRep::Hash Hash;
+
+/// @brief A hash whose least significant 64 bits are @p low, the rest @p seed bytes
+static Hash challenge_with_low_bits(uint64_t low, uint64_t seed) {
+    std::vector<uint8_t> bytes = test::random_bytes(sizeof(Hash), seed);
+    for (size_t i = 0; i < sizeof(uint64_t); i++)
+        bytes[sizeof(Hash) - 1 - i] = low >> (8 * i);
+    return Hash(bytes.data());
+}
+
+static void challenge_reaches_every_leaf() {
+    for (size_t leaves : {size_t(64), size_t(1024), size_t(4096), size_t(1) << 20}) {
+        CHECK(challenge_with_low_bits(leaves - 1, 1) % leaves == leaves - 1);
+        CHECK(challenge_with_low_bits(leaves + 3, 2) % leaves == 3);
+    }
+
+    // Random challenges spread over the whole tree, not the first 256 leaves
+    std::vector<uint8_t> bytes = test::random_bytes(300 * sizeof(Hash), 3);
+    std::set<uint64_t> quarters;
+    for (size_t i = 0; i < 300; i++)
+        quarters.insert((Hash(bytes.data() + i * sizeof(Hash)) % 4096) / 1024);
+    CHECK(quarters.size() == 4);
+}
+
+/// @brief Checks the dependency table of a geometry against the proof paths of every leaf group
+template <size_t FANOUT, size_t LEAVES>
+static void check_dependencies() {
+    typedef PoRepT<32, merkle::sha256, FANOUT, LEAVES> PoRep;
+    const std::vector<int>& dep = PoRep::dependency_table();
+    CHECK(dep.size() == PoRep::TOTAL);
+    // Decoding walks from the root down, so a node depends on a later one
+    for (size_t i = 0; i + 1 < PoRep::TOTAL; i++)
+        CHECK(size_t(dep[i]) > i && size_t(dep[i]) < PoRep::TOTAL);
+
+    for (int leaf = 0; leaf < int(LEAVES); leaf += FANOUT) {
+        std::vector<int> path = PoRep::get_path_indexes(leaf);
+        CHECK(path.size() == PoRep::Proof::n);
+        std::set<int> nodes(path.begin(), path.end());
+        for (size_t j = 0; j + 1 < path.size(); j++)
+            CHECK(nodes.count(dep[path[j]]) == 1);
+        CHECK(path.back() == int(PoRep::TOTAL) - 1);
+    }
+}
+
+static void dependencies_within_proofs() {
+    check_dependencies<2, 64>();
+    check_dependencies<4, 64>();
+    check_dependencies<4, 1024>();
+    check_dependencies<8, 64>();
+    check_dependencies<8, 4096>();
+}
+
+static void parse_geometries() {
+    CHECK(Geometry::parse("4x1024") == (Geometry{4, 1024, "sha256"}));
+    CHECK(Geometry::parse("8x4096:sha256").to_string() == "8x4096:sha256");
+    for (const char* bad : {"", "x64", "4x", "4y64", "ax64", "4x:sha256"}) {
+        bool thrown = false;
+        try {
+            Geometry::parse(bad);
+        }
+        catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+
+    bool thrown = false;
+    try {
+        make_porep(Geometry{3, 81, "sha256"});
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+/// @brief Plots @p chunks chunks with @p geometry and proves leaves all over the trees
+static void plot_and_prove(const Geometry& geometry, size_t chunks) {
+    test::TempDir dir;
+    PlotConfig config;
+    config.plot_dir = dir.path.string();
+    auto p = make_porep(geometry, config);
+    CHECK(p->geometry() == geometry);
+    CHECK(p->chunk_size() == geometry.leaves * sizeof(Hash));
+
+    std::vector<uint8_t> input = test::random_bytes(chunks * p->chunk_size(), geometry.leaves);
+    p->plot(input.data(), input.size());
+    CHECK(size_t(p->get_plots() + p->get_conflicts()) == chunks);
+    CHECK(p->roots() == size_t(p->get_plots()));
+    for (const auto& entry : fs::directory_iterator(dir.path))
+        CHECK(size_t(fs::file_size(entry.path())) == p->plot_file_size());
+
+    for (size_t i = 0; i < 32; i++) {
+        Hash challenge = challenge_with_low_bits(i * geometry.leaves / 32 + i % geometry.fanout, i);
+        DynamicProof proof = p->generate_proof(challenge);
+        CHECK(proof.hashes.size() == p->proof_hashes());
+        CHECK(proof.bytes() == p->proof_hashes() * sizeof(Hash));
+        CHECK(p->verify(proof, challenge));
+
+        // A proof only answers the leaf group it was generated for
+        Hash other = challenge_with_low_bits((i * geometry.leaves / 32 + geometry.leaves / 2) % geometry.leaves, i);
+        CHECK(!p->verify(proof, other));
+        DynamicProof tampered = proof;
+        tampered.hashes[0].bytes[0] ^= 1;
+        CHECK(!p->verify(tampered, challenge));
+        tampered.hashes.pop_back();
+        CHECK(!p->verify(tampered, challenge));
+    }
+}
+
+static void dynamic_porep() {
+    plot_and_prove(Geometry{2, 64, "sha256"}, 8);
+    plot_and_prove(Geometry{2, 1024, "sha256"}, 4);
+    plot_and_prove(Geometry{4, 1024, "sha256"}, 4);
+    plot_and_prove(Geometry{8, 4096, "sha256"}, 2);
+}
+
+int main() {
+    return test::run({
+        {"challenge_reaches_every_leaf", challenge_reaches_every_leaf},
+        {"dependencies_within_proofs", dependencies_within_proofs},
+        {"parse_geometries", parse_geometries},
+        {"dynamic_porep", dynamic_porep},
+    });
+}
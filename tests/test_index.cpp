@@ -0,0 +1,145 @@
+#include "por.hpp"
+#include "check.hpp"
+
+#include <signal.h>
+#include <sys/resource.h>
+
+// The root index on its own: compact snapshots agree with normal ones, bulk
+// loads merge like single insertions, and a sidecar that cannot be written
+// leaves the published snapshot alone.
+
+using namespace por;
+
+typedef PoRep::Hash Hash;
+typedef RootIndexT<Hash, int> Index;
+
+static std::vector<Hash> random_roots(size_t count, uint64_t seed) {
+    std::vector<uint8_t> bytes = test::random_bytes(count * sizeof(Hash), seed);
+    std::vector<Hash> roots;
+    for (size_t i = 0; i < count; i++)
+        roots.push_back(Hash(bytes.data() + i * sizeof(Hash)));
+    return roots;
+}
+
+static void compact_matches_normal() {
+    test::TempDir dir;
+    Index normal(100), compact(100, dir.path.string());
+    std::vector<Hash> roots = random_roots(5000, 1);
+    for (size_t i = 0; i < roots.size(); i++) {
+        CHECK(normal.insert(roots[i], i) == compact.insert(roots[i], i));
+        if (i % 7 == 0)
+            CHECK(normal.erase(roots[i / 2]) == compact.erase(roots[i / 2]));
+        normal.maybe_publish();
+        compact.maybe_publish();
+    }
+    normal.publish();
+    compact.publish();
+
+    auto a = normal.snapshot(), b = compact.snapshot();
+    CHECK(a->size() == b->size());
+    CHECK(std::equal(a->begin(), a->end(), b->begin(),
+        [](const Index::Entry& x, const Index::Entry& y) { return x.root == y.root && x.value == y.value; }));
+    for (const Hash& c : random_roots(1000, 2))
+        CHECK(a->closest(c)->root == b->closest(c)->root);
+    // Sidecars are unlinked once mapped
+    CHECK(fs::is_empty(dir.path));
+}
+
+static void bulk_insert(const std::string& sidecar_dir) {
+    Index index(1 << 20, sidecar_dir);
+    std::vector<Hash> roots = random_roots(3000, 4);
+    std::vector<Index::Entry> entries;
+    for (size_t i = 0; i < roots.size(); i++)
+        entries.push_back({roots[i], int(i)});
+
+    // A first load into an empty index, with a repeated root
+    std::vector<Index::Entry> first(entries.begin(), entries.begin() + 1000);
+    first.push_back({roots[10], -1});
+    index.bulk_insert(first);
+    CHECK(index.snapshot()->size() == 1000);
+    CHECK(index.snapshot()->find(roots[10])->value == 10);
+
+    // Later loads merge with the published and the pending roots
+    index.insert(roots[1000], 1000);
+    index.erase(roots[0]);
+    std::vector<Index::Entry> second(entries.begin() + 1, entries.end());
+    std::reverse(second.begin(), second.end());
+    std::vector<Hash> accepted;
+    index.bulk_insert(second, [&](Index::Entry& e) {
+        accepted.push_back(e.root);
+        e.value = -e.value;
+    });
+    CHECK(accepted.size() == roots.size() - 1001);
+    CHECK(std::is_sorted(accepted.begin(), accepted.end()));
+
+    auto snapshot = index.snapshot();
+    CHECK(snapshot->size() == roots.size() - 1);
+    CHECK(index.size() == snapshot->size());
+    CHECK(std::is_sorted(snapshot->begin(), snapshot->end(),
+        [](const Index::Entry& a, const Index::Entry& b) { return a.root < b.root; }));
+    CHECK(snapshot->find(roots[0]) == nullptr);
+    for (size_t i = 1; i < roots.size(); i++)
+        CHECK(snapshot->find(roots[i])->value == (i <= 1000 ? int(i) : -int(i)));
+}
+
+static void bulk_insert_normal() {
+    bulk_insert("");
+}
+
+static void bulk_insert_compact() {
+    test::TempDir dir;
+    bulk_insert(dir.path.string());
+    CHECK(fs::is_empty(dir.path));
+}
+
+static void sidecar_short_write() {
+    test::TempDir dir;
+    Index index(1 << 20, dir.path.string());
+    std::vector<Hash> roots = random_roots(1000, 3);
+    for (size_t i = 0; i < 10; i++)
+        index.insert(roots[i], i);
+    index.publish();
+    for (size_t i = 10; i < roots.size(); i++)
+        index.insert(roots[i], i);
+
+    // Too small a file size limit makes the sidecar write fail like a full disk
+    rlimit old;
+    CHECK(getrlimit(RLIMIT_FSIZE, &old) == 0);
+    rlimit small = old;
+    small.rlim_cur = 4096;
+    auto handler = signal(SIGXFSZ, SIG_IGN);
+    CHECK(setrlimit(RLIMIT_FSIZE, &small) == 0);
+    bool thrown = false;
+    try {
+        index.publish();
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(setrlimit(RLIMIT_FSIZE, &old) == 0);
+    signal(SIGXFSZ, handler);
+    CHECK(thrown);
+
+    // Readers keep the previous snapshot and the changes stay pending
+    auto before = index.snapshot();
+    CHECK(before->size() == 10);
+    for (const Index::Entry& e : *before)
+        CHECK(e.root == roots[e.value]);
+    CHECK(index.size() == roots.size());
+    CHECK(fs::is_empty(dir.path));
+
+    index.publish();
+    auto after = index.snapshot();
+    CHECK(after->size() == roots.size());
+    for (size_t i = 0; i < roots.size(); i++)
+        CHECK(after->find(roots[i])->value == int(i));
+}
+
+int main() {
+    return test::run({
+        {"compact_matches_normal", compact_matches_normal},
+        {"bulk_insert_normal", bulk_insert_normal},
+        {"bulk_insert_compact", bulk_insert_compact},
+        {"sidecar_short_write", sidecar_short_write},
+    });
+}
@@ -0,0 +1,242 @@
+#include "merkle.hpp"
+#include "check.hpp"
+
+#include <set>
+
+// Hashes as big-endian numbers: the 64-bit limb arithmetic agrees with a
+// byte by byte reference, for sizes with and without whole limbs. The hex
+// codec round-trips and rejects anything but hex digits. The blocked layout
+// places every node once, inside a block, and keeps the proof of a leaf
+// within one block per band of levels.
+
+using namespace merkle;
+
+/// @brief Byte by byte a - b, assuming a >= b
+template <size_t SIZE>
+static HashT<SIZE> reference_difference(const HashT<SIZE>& a, const HashT<SIZE>& b) {
+    HashT<SIZE> res;
+    int borrow = 0;
+    for (size_t i = SIZE; i-- > 0;) {
+        int d = int(a.bytes[i]) - int(b.bytes[i]) - borrow;
+        borrow = d < 0;
+        res.bytes[i] = uint8_t(d + 256 * borrow);
+    }
+    return res;
+}
+
+/// @brief Pairs of hashes that stress comparisons and borrows
+template <size_t SIZE>
+static std::vector<std::pair<HashT<SIZE>, HashT<SIZE>>> hash_pairs() {
+    std::vector<uint8_t> bytes = test::random_bytes(2000 * SIZE, SIZE);
+    std::vector<std::pair<HashT<SIZE>, HashT<SIZE>>> pairs;
+    for (size_t i = 0; i < 1000; i++)
+        pairs.push_back({HashT<SIZE>(bytes.data() + 2 * i * SIZE), HashT<SIZE>(bytes.data() + (2 * i + 1) * SIZE)});
+
+    for (size_t i = 0; i < SIZE; i++) {
+        // Equal but for byte i, in both directions
+        HashT<SIZE> a = pairs[i].first, b = a;
+        b.bytes[i] ^= 0x80;
+        pairs.push_back({a, b});
+        // 1 followed by zeros minus 0 followed by ones borrows across every limb below i
+        HashT<SIZE> one, ones;
+        one.bytes[i] = 1;
+        for (size_t j = i + 1; j < SIZE; j++)
+            ones.bytes[j] = 0xFF;
+        pairs.push_back({one, ones});
+    }
+    pairs.push_back({pairs[0].first, pairs[0].first});
+    return pairs;
+}
+
+template <size_t SIZE>
+static void check_arithmetic() {
+    for (const auto& p : hash_pairs<SIZE>()) {
+        const HashT<SIZE>& a = p.first;
+        const HashT<SIZE>& b = p.second;
+        int expected = memcmp(a.bytes, b.bytes, SIZE);
+        expected = (expected > 0) - (expected < 0);
+        CHECK(a.compare(b) == expected);
+        CHECK(b.compare(a) == -expected);
+        CHECK((a < b) == (expected < 0));
+        CHECK((a <= b) == (expected <= 0));
+        CHECK((a == b) == (expected == 0));
+
+        const HashT<SIZE>& big = expected >= 0 ? a : b;
+        const HashT<SIZE>& small = expected >= 0 ? b : a;
+        CHECK(big - small == reference_difference(big, small));
+        CHECK(a.distance(b) == reference_difference(big, small));
+        CHECK(b.distance(a) == a.distance(b));
+    }
+}
+
+static void limb_arithmetic() {
+    check_arithmetic<32>();
+    check_arithmetic<64>();
+}
+
+static void byte_arithmetic() {
+    check_arithmetic<20>();
+    check_arithmetic<4>();
+}
+
+static void big_endian_uint64() {
+    uint8_t bytes[32];
+    for (size_t i = 0; i < sizeof(bytes); i++)
+        bytes[i] = uint8_t(i + 1);
+    CHECK(HashT<32>(bytes).to_uint64() == 0x0102030405060708ull);
+    // Shorter hashes are the top bytes of the number
+    CHECK(HashT<4>(bytes).to_uint64() == 0x0102030400000000ull);
+
+    // The leading limb orders hashes like compare() does
+    for (const auto& p : hash_pairs<32>()) {
+        if (p.first < p.second)
+            CHECK(p.first.to_uint64() <= p.second.to_uint64());
+        if (p.first.to_uint64() < p.second.to_uint64())
+            CHECK(p.first < p.second);
+    }
+}
+
+static void hex_round_trip() {
+    std::vector<uint8_t> bytes(256);
+    for (size_t i = 0; i < 256; i++)
+        bytes[i] = uint8_t(i);
+    std::string lower(512, '_'), upper(512, '_');
+    hex_encode(bytes.data(), bytes.size(), &lower[0]);
+    hex_encode(bytes.data(), bytes.size(), &upper[0], false);
+    CHECK(lower.substr(0, 8) == "00010203" && lower.substr(500) == "fafbfcfdfeff");
+    CHECK(upper.substr(500) == "FAFBFCFDFEFF");
+
+    std::vector<uint8_t> decoded(256);
+    CHECK(hex_decode(lower.data(), decoded.size(), decoded.data()) && decoded == bytes);
+    CHECK(hex_decode(upper.data(), decoded.size(), decoded.data()) && decoded == bytes);
+
+    HashT<32> h(bytes.data() + 100);
+    CHECK(HashT<32>(h.to_string()) == h);
+    CHECK(HashT<32>(h.to_string(32, false)) == h);
+    CHECK(h.to_string(4) == "64656667");
+}
+
+static void hex_rejects_invalid() {
+    const std::string valid = "0123456789abcdefABCDEF0123456789";
+    uint8_t out[16];
+    CHECK(hex_decode(valid.data(), sizeof(out), out));
+
+    // Every character that is not a hex digit fails, wherever it is
+    for (int c = 0; c < 256; c++) {
+        bool digit = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+        for (size_t pos : {size_t(0), size_t(1), size_t(17), valid.size() - 1}) {
+            std::string s = valid;
+            s[pos] = char(c);
+            CHECK(hex_decode(s.data(), sizeof(out), out) == digit);
+        }
+    }
+
+    std::string hash(64, 'a');
+    for (const std::string& bad : {hash.substr(1), hash + "a", hash.substr(0, 63) + "g", hash.substr(0, 31) + " " + hash.substr(32),
+                                   std::string("0x") + hash.substr(2), std::string()}) {
+        bool thrown = false;
+        try {
+            HashT<32> h(bad);
+        }
+        catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+}
+
+/// @brief Level order indexes of a leaf, its siblings and those of every ancestor, and the root
+template <size_t FANOUT, size_t LEAVES>
+static std::vector<size_t> proof_nodes(size_t leaf) {
+    std::vector<size_t> path;
+    size_t base = 0, index = leaf;
+    for (size_t width = LEAVES; width > 1; width /= FANOUT) {
+        size_t first = index - index % FANOUT;
+        for (size_t i = 0; i < FANOUT; i++)
+            path.push_back(base + first + i);
+        base += width;
+        index /= FANOUT;
+    }
+    path.push_back(base);
+    return path;
+}
+
+/// @brief Checks the positions of every node of a blocked layout and serializes a tree with it
+template <size_t FANOUT, size_t LEAVES>
+static void check_blocked(size_t block_size) {
+    typedef LayoutT<32, FANOUT, LEAVES> Layout;
+    typedef TreeT<32, sha256, FANOUT, LEAVES> Tree;
+    const size_t total = (FANOUT * LEAVES - 1) / (FANOUT - 1);
+    Layout layout(merkle::Layout::blocked, block_size);
+    CHECK(layout.size() % block_size == 0);
+
+    // Every node gets its own slot, after the header and within a single block
+    std::set<size_t> positions;
+    for (size_t i = 0; i < total; i++) {
+        size_t p = layout.position(i);
+        CHECK(p >= Layout::HEADER && p + 32 <= layout.size());
+        CHECK(p / block_size == (p + 31) / block_size);
+        positions.insert(p);
+    }
+    CHECK(positions.size() == total);
+    for (auto it = positions.begin(); std::next(it) != positions.end(); ++it)
+        CHECK(*std::next(it) - *it >= 32);
+    // The root leads the first block, right after the header
+    CHECK(layout.position(total - 1) == Layout::HEADER);
+
+    // A proof reads the first block and one block per band below it
+    size_t bands = (layout.depth - layout.top + layout.height - 1) / layout.height;
+    for (size_t leaf = 0; leaf < LEAVES; leaf += FANOUT) {
+        std::set<size_t> blocks;
+        for (size_t node : proof_nodes<FANOUT, LEAVES>(leaf))
+            blocks.insert(layout.position(node) / block_size);
+        CHECK(blocks.size() == 1 + bands);
+    }
+
+    test::TempDir dir;
+    Tree tree(test::random_bytes(LEAVES * 32, LEAVES), 12345);
+    tree.serialize(dir / "tree", layout);
+    std::ifstream f(dir / "tree", std::ifstream::binary);
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    CHECK(bytes.size() == layout.size());
+    size_t begin = 0;
+    CHECK(deserialise_uint64_t(bytes, begin) == 12345);
+    for (size_t i = 0; i < total; i++)
+        CHECK(HashT<32>(bytes.data() + layout.position(i)) == tree.nodes[i]);
+}
+
+static void blocked_layout() {
+    check_blocked<2, 64>(4096);
+    check_blocked<2, 1024>(4096);
+    check_blocked<2, 1024>(512);
+    check_blocked<4, 1024>(4096);
+    check_blocked<8, 4096>(4096);
+    check_blocked<8, 4096>(2560);
+
+    // The level layout is TreeT::nodes behind the header
+    typedef LayoutT<32, 4, 1024> Level;
+    Level level;
+    CHECK(level.position(0) == Level::HEADER);
+    CHECK(level.position(1364) == Level::HEADER + 1364 * 32);
+    CHECK(level.size() == Level::HEADER + 1365 * 32);
+
+    bool thrown = false;
+    try {
+        LayoutT<32, 8, 4096> small(merkle::Layout::blocked, 255);
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+int main() {
+    return test::run({
+        {"limb_arithmetic", limb_arithmetic},
+        {"byte_arithmetic", byte_arithmetic},
+        {"big_endian_uint64", big_endian_uint64},
+        {"hex_round_trip", hex_round_trip},
+        {"hex_rejects_invalid", hex_rejects_invalid},
+        {"blocked_layout", blocked_layout},
+    });
+}
@@ -0,0 +1,679 @@
+#include "shards.hpp"
+#include "check.hpp"
+
+#include <signal.h>
+#include <sys/wait.h>
+
+// Plot runs that are interrupted and resumed end up with the same store as
+// an uninterrupted run; replotting one input leaves the plots of the
+// others alone, and a sharded store keeps one copy of every root.
+
+using namespace por;
+
+/// @brief Names and contents of the plot files in @p dir
+static std::map<std::string, std::string> plot_files(const std::string& dir) {
+    std::map<std::string, std::string> files;
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        std::string name = entry.path().filename();
+        if (name.size() != 2 * sizeof(PoRep::Hash))
+            continue;
+        std::ifstream f(entry.path(), std::ifstream::binary);
+        files[name] = std::string(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    }
+    return files;
+}
+
+/// @brief Plots @p input in a child process that is killed once @p chunks chunks are done
+static void plot_killed_after(const PlotConfig& config, const std::string& input, uint64_t chunks) {
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid == 0) {
+        PoRep p(config);
+        std::thread killer([&]() {
+            while (p.progress.done < chunks)
+                std::this_thread::yield();
+            kill(getpid(), SIGKILL);
+        });
+        p.plot(const_cast<char*>(input.c_str()));
+        _exit(0);
+    }
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL);
+}
+
+/// @brief Proves random challenges against @p p
+static void check_proofs(PoRep& p, uint64_t seed) {
+    std::vector<uint8_t> bytes = test::random_bytes(64 * sizeof(PoRep::Hash), seed);
+    for (size_t i = 0; i < 64; i++) {
+        PoRep::Hash challenge(bytes.data() + i * sizeof(PoRep::Hash));
+        CHECK(p.verify(p.generate_proof(challenge), challenge));
+    }
+}
+
+static void resume_after_first_chunk() {
+    test::TempDir dir;
+    std::string input = dir / "input";
+    test::write_file(input, test::random_bytes(24 * PoRep::CHUNK_SIZE, 1));
+
+    PlotConfig clean;
+    clean.plot_dir = dir / "clean";
+    fs::create_directories(clean.plot_dir);
+    PoRep reference(clean);
+    reference.plot(const_cast<char*>(input.c_str()));
+
+    // The first checkpoint interval is never reached before the kill
+    PlotConfig config;
+    config.plot_dir = dir / "plot";
+    config.checkpoint_interval = 1000;
+    config.manifest = true;
+    fs::create_directories(config.plot_dir);
+    plot_killed_after(config, input, 1);
+    CHECK(fs::exists(config.plot_dir + "/input.checkpoint"));
+    CHECK(!plot_files(config.plot_dir).empty());
+
+    PoRep resumed(config);
+    resumed.plot(const_cast<char*>(input.c_str()));
+    CHECK(!fs::exists(config.plot_dir + "/input.checkpoint"));
+    CHECK(resumed.get_plots() == reference.get_plots());
+    CHECK(resumed.get_conflicts() == reference.get_conflicts());
+    CHECK(plot_files(config.plot_dir) == plot_files(clean.plot_dir));
+
+    PoRep::Manifest manifest;
+    CHECK(manifest.load(config.plot_dir + "/input.manifest"));
+    CHECK(manifest.chunks.size() == 24);
+    check_proofs(resumed, 2);
+}
+
+static void resume_mid_run() {
+    test::TempDir dir;
+    std::string input = dir / "input";
+    test::write_file(input, test::random_bytes(40 * PoRep::CHUNK_SIZE, 3));
+
+    PlotConfig clean;
+    clean.plot_dir = dir / "clean";
+    fs::create_directories(clean.plot_dir);
+    PoRep reference(clean);
+    reference.plot(const_cast<char*>(input.c_str()));
+
+    PlotConfig config;
+    config.plot_dir = dir / "plot";
+    config.checkpoint_interval = 8;
+    fs::create_directories(config.plot_dir);
+    plot_killed_after(config, input, 20);
+
+    PoRep resumed(config);
+    resumed.plot(const_cast<char*>(input.c_str()));
+    CHECK(resumed.get_plots() == reference.get_plots());
+    CHECK(plot_files(config.plot_dir) == plot_files(clean.plot_dir));
+    check_proofs(resumed, 4);
+}
+
+/// @brief Chunk @p i of the inputs of the replot tests
+static std::vector<uint8_t> chunk(uint64_t i) {
+    return test::random_bytes(PoRep::CHUNK_SIZE, 1000 + i);
+}
+
+static void write_chunks(const std::string& path, const std::vector<uint64_t>& chunks) {
+    std::vector<uint8_t> bytes;
+    for (uint64_t i : chunks) {
+        std::vector<uint8_t> c = chunk(i);
+        bytes.insert(bytes.end(), c.begin(), c.end());
+    }
+    test::write_file(path, bytes);
+}
+
+/// @brief Checks that the plot of every chunk of @p manifest_file is indexed and proves
+static void check_manifest(PoRep& p, const std::string& manifest_file) {
+    PoRep::Manifest manifest;
+    CHECK(manifest.load(manifest_file));
+    auto snapshot = p.search.snapshot();
+    for (const auto& c : manifest.chunks) {
+        CHECK(snapshot->find(c.root) != nullptr);
+        // A challenge equal to a root is proven from that plot
+        auto proof = p.generate_proof(c.root);
+        CHECK(proof.root() == c.root);
+        CHECK(p.verify(proof, c.root));
+    }
+}
+
+static void replot_shared_chunk() {
+    test::TempDir dir;
+    std::string a = dir / "a", b = dir / "b";
+    write_chunks(a, {0, 1, 2, 3});
+    write_chunks(b, {4, 0, 5});
+
+    PlotConfig config;
+    config.plot_dir = dir / "plot";
+    config.manifest = true;
+    fs::create_directories(config.plot_dir);
+    PoRep p(config);
+    p.plot(const_cast<char*>(a.c_str()));
+    p.plot(const_cast<char*>(b.c_str()));
+    CHECK(p.get_conflicts() == 1);
+
+    // Chunk 0 of a changes, b still holds it
+    write_chunks(a, {6, 1, 2, 3});
+    p.replot(const_cast<char*>(a.c_str()));
+    check_manifest(p, config.plot_dir + "/a.manifest");
+    check_manifest(p, config.plot_dir + "/b.manifest");
+
+    // Once b drops it too, nothing references it any more
+    PoRep::Manifest old_b;
+    CHECK(old_b.load(config.plot_dir + "/b.manifest"));
+    write_chunks(b, {4, 7, 5});
+    p.replot(const_cast<char*>(b.c_str()));
+    CHECK(p.search.snapshot()->find(old_b.chunks[1].root) == nullptr);
+    CHECK(!fs::exists(config.plot_dir + "/" + old_b.chunks[1].root.to_string()));
+    check_manifest(p, config.plot_dir + "/a.manifest");
+    check_manifest(p, config.plot_dir + "/b.manifest");
+
+    // A fresh prover sees the same store
+    PoRep reloaded(config);
+    reloaded.load_plot(config.plot_dir);
+    CHECK(reloaded.search.size() == 7);
+    check_manifest(reloaded, config.plot_dir + "/a.manifest");
+    check_manifest(reloaded, config.plot_dir + "/b.manifest");
+}
+
+static void segment_dead_records() {
+    test::TempDir dir;
+    std::string a = dir / "a";
+    write_chunks(a, {0, 1, 2, 3});
+
+    PlotConfig config;
+    config.plot_dir = dir / "plot";
+    fs::create_directories(config.plot_dir);
+    PoRep p(config);
+    p.plot(const_cast<char*>(a.c_str()));
+    CHECK(p.compact().segments == 1);
+    auto first = *p.search.snapshot()->begin();
+
+    // Mark the record of the smallest root dead in the segment's roots list
+    std::string roots_file = p.segment_path(first.value.segment) + ".roots";
+    std::vector<std::string> lines;
+    std::ifstream f(roots_file);
+    for (std::string line; std::getline(f, line);)
+        lines.push_back(line);
+    f.close();
+    CHECK(lines.size() == 4 && lines[first.value.record] == first.root.to_string());
+    lines[first.value.record] = PoRep::DEAD_RECORD;
+    std::string roots;
+    for (const std::string& line : lines)
+        roots += line + "\n";
+    write_atomically(roots_file, roots);
+
+    PoRep reloaded(config);
+    reloaded.load_plot(config.plot_dir);
+    CHECK(reloaded.search.size() == 3);
+    CHECK(reloaded.search.snapshot()->find(first.root) == nullptr);
+    check_proofs(reloaded, 5);
+
+    // Compaction drops the dead record with the rest of the segment
+    CHECK(reloaded.compact().segments == 1);
+    PoRep compacted(config);
+    compacted.load_plot(config.plot_dir);
+    CHECK(compacted.search.size() == 3);
+    check_proofs(compacted, 6);
+}
+
+static void replot_packed_chunk() {
+    test::TempDir dir;
+    std::string a = dir / "a";
+    write_chunks(a, {0, 1, 2, 3});
+
+    PlotConfig config;
+    config.plot_dir = dir / "plot";
+    config.manifest = true;
+    fs::create_directories(config.plot_dir);
+    PoRep p(config);
+    p.plot(const_cast<char*>(a.c_str()));
+    p.compact();
+    CHECK(plot_files(config.plot_dir).empty());
+
+    PoRep::Manifest old_a;
+    CHECK(old_a.load(config.plot_dir + "/a.manifest"));
+    write_chunks(a, {6, 1, 2, 3});
+    p.replot(const_cast<char*>(a.c_str()));
+    CHECK(p.search.snapshot()->find(old_a.chunks[0].root) == nullptr);
+
+    // The stale record is still in its segment but no longer loaded
+    PoRep reloaded(config);
+    reloaded.load_plot(config.plot_dir);
+    CHECK(reloaded.search.size() == 4);
+    CHECK(reloaded.search.snapshot()->find(old_a.chunks[0].root) == nullptr);
+    check_manifest(reloaded, config.plot_dir + "/a.manifest");
+
+    reloaded.compact();
+    PoRep compacted(config);
+    compacted.load_plot(config.plot_dir);
+    CHECK(compacted.search.size() == 4);
+    check_manifest(compacted, config.plot_dir + "/a.manifest");
+}
+
+/// @brief File names of @p paths, sorted
+static std::vector<std::string> names(const std::vector<std::string>& paths) {
+    std::vector<std::string> result;
+    for (const std::string& path : paths)
+        result.push_back(fs::path(path).filename());
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+static void audit_quarantine() {
+    test::TempDir dir;
+    std::string a = dir / "a";
+    write_chunks(a, {0, 1, 2, 3, 4, 5, 6, 7});
+
+    PlotConfig config;
+    config.plot_dir = dir / "plot";
+    fs::create_directories(config.plot_dir);
+    PoRep p(config);
+    p.plot(const_cast<char*>(a.c_str()));
+    AuditReport clean = p.audit(2);
+    CHECK(clean.checked == 8 && clean.corrupt.empty() && clean.orphans.empty() && clean.missing.empty());
+
+    // A flipped node, a torn file, a deleted plot, an unindexed plot, a stray
+    // file and a sidecar
+    std::map<std::string, std::string> files = plot_files(config.plot_dir);
+    std::vector<std::string> plots;
+    for (const auto& f : files)
+        plots.push_back(f.first);
+    std::string flipped = files[plots[0]];
+    flipped[flipped.size() / 2] ^= 1;
+    write_atomically(config.plot_dir + "/" + plots[0], flipped);
+    write_atomically(config.plot_dir + "/" + plots[1], files[plots[1]].substr(1));
+    fs::remove(config.plot_dir + "/" + plots[2]);
+    std::string unindexed = PoRep::Hash(chunk(100).data()).to_string();
+    write_atomically(config.plot_dir + "/" + unindexed, files[plots[3]]);
+    write_atomically(config.plot_dir + "/notes.txt", "stray");
+    write_atomically(config.plot_dir + "/a.salt", "1");
+
+    std::vector<std::string> corrupt = {plots[0], plots[1]};
+    std::vector<std::string> orphans = {unindexed, "notes.txt"};
+    std::sort(orphans.begin(), orphans.end());
+    AuditReport report = p.audit(2);
+    CHECK(report.checked == 7);
+    CHECK(names(report.corrupt) == corrupt);
+    CHECK(names(report.orphans) == orphans);
+    CHECK(names(report.missing) == std::vector<std::string>{plots[2]});
+    // Without quarantine nothing moves
+    CHECK(fs::exists(config.plot_dir + "/" + plots[0]) && fs::exists(config.plot_dir + "/notes.txt"));
+    CHECK(p.search.size() == 8);
+
+    // Quarantine moves the corrupt plots and the orphans aside and drops the corrupt roots
+    report = p.audit(2, true);
+    CHECK(names(report.corrupt) == corrupt);
+    CHECK(names(report.orphans) == orphans);
+    std::vector<std::string> moved;
+    for (const auto& entry : fs::directory_iterator(config.plot_dir + "/quarantine"))
+        moved.push_back(entry.path().filename());
+    std::sort(moved.begin(), moved.end());
+    std::vector<std::string> expected = {plots[0], plots[1], unindexed, "notes.txt"};
+    std::sort(expected.begin(), expected.end());
+    CHECK(moved == expected);
+    CHECK(fs::exists(config.plot_dir + "/a.salt"));
+    CHECK(p.search.size() == 6);
+    for (size_t i = 0; i < 2; i++) {
+        PoRep::Hash root(plots[i]);
+        CHECK(p.search.snapshot()->find(root) == nullptr);
+    }
+
+    // Only the missing plot is left to report, and a fresh prover does not know it
+    report = p.audit(2);
+    CHECK(report.checked == 5 && report.corrupt.empty() && report.orphans.empty());
+    CHECK(names(report.missing) == std::vector<std::string>{plots[2]});
+    PoRep reloaded(config);
+    reloaded.load_plot(config.plot_dir);
+    CHECK(reloaded.search.size() == 5);
+    report = reloaded.audit(2);
+    CHECK(report.checked == 5 && report.corrupt.empty() && report.orphans.empty() && report.missing.empty());
+    check_proofs(reloaded, 7);
+
+    // A bad record of a segment is reported by position and left for compact()
+    CHECK(reloaded.compact().segments == 1);
+    auto victim = *reloaded.search.snapshot()->begin();
+    std::string segment = reloaded.segment_path(victim.value.segment);
+    std::fstream f(segment, std::fstream::in | std::fstream::out | std::fstream::binary);
+    size_t middle = reloaded.plot_base(victim.value) + reloaded.plot_file_size() / 2;
+    f.seekg(middle);
+    char byte = f.get();
+    f.seekp(middle);
+    f.put(byte ^ 1);
+    f.close();
+    report = reloaded.audit(2, true);
+    CHECK(report.checked == 5);
+    CHECK(report.corrupt == std::vector<std::string>{segment + "@" + std::to_string(victim.value.record)});
+    CHECK(fs::exists(segment));
+    CHECK(reloaded.search.size() == 4);
+    CHECK(reloaded.search.snapshot()->find(victim.root) == nullptr);
+}
+
+static void replot_reuses_cache_slots() {
+    test::TempDir dir;
+    std::string a = dir / "a";
+    write_chunks(a, {0, 1, 2, 3});
+
+    // Room for the four plots and one more
+    PlotConfig config;
+    config.plot_dir = dir / "plot";
+    config.manifest = true;
+    config.cache_levels = 3;
+    config.cache_budget = 5 * 7 * sizeof(PoRep::Hash);
+    fs::create_directories(config.plot_dir);
+    PoRep p(config);
+    p.plot(const_cast<char*>(a.c_str()));
+
+    for (uint64_t round = 0; round < 4; round++) {
+        write_chunks(a, {0, 10 + round, 2, 3});
+        p.replot(const_cast<char*>(a.c_str()));
+        PoRep::Manifest manifest;
+        CHECK(manifest.load(config.plot_dir + "/a.manifest"));
+        auto snapshot = p.search.snapshot();
+        CHECK(snapshot->size() == 4);
+        for (const auto& c : manifest.chunks)
+            CHECK(snapshot->find(c.root)->value.cache_slot != PoRep::NO_SLOT);
+        check_manifest(p, config.plot_dir + "/a.manifest");
+    }
+}
+
+static PlotConfig encrypted(const std::string& plot_dir) {
+    PlotConfig config;
+    config.plot_dir = plot_dir;
+    config.manifest = true;
+    config.encryption_key = test::random_bytes(ChunkCipher::KEY_SIZE, 20);
+    config.encryption_iv = test::random_bytes(ChunkCipher::BLOCK_SIZE, 21);
+    fs::create_directories(plot_dir);
+    return config;
+}
+
+static void encryption_salts_every_input() {
+    test::TempDir dir;
+    std::string a = dir / "a", b = dir / "b";
+    write_chunks(a, {0, 1, 2, 3});
+    write_chunks(b, {0, 1, 2, 3});
+
+    // The same data under the same key and IV gets another keystream per input
+    PlotConfig config = encrypted(dir / "plot");
+    PoRep p(config);
+    p.plot(const_cast<char*>(a.c_str()));
+    p.plot(const_cast<char*>(b.c_str()));
+    CHECK(p.get_plots() == 8);
+    CHECK(p.get_conflicts() == 0);
+    PoRep::Manifest ma, mb;
+    CHECK(ma.load(config.plot_dir + "/a.manifest") && mb.load(config.plot_dir + "/b.manifest"));
+    CHECK(ma.salt != mb.salt);
+
+    // Replotting reuses the input's keystream, so unchanged chunks stay
+    write_chunks(a, {0, 1, 9, 3});
+    p.replot(const_cast<char*>(a.c_str()));
+    PoRep::Manifest replotted;
+    CHECK(replotted.load(config.plot_dir + "/a.manifest"));
+    CHECK(replotted.salt == ma.salt);
+    CHECK(p.get_plots() == 9);
+    for (size_t i : {0, 1, 3})
+        CHECK(replotted.chunks[i].root == ma.chunks[i].root);
+    CHECK(plot_files(config.plot_dir).size() == 8);
+    check_manifest(p, config.plot_dir + "/a.manifest");
+    check_manifest(p, config.plot_dir + "/b.manifest");
+
+    PlotConfig unset = config;
+    unset.encryption_iv.clear();
+    bool thrown = false;
+    try {
+        PoRep q(unset);
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+static void encryption_resumes_with_its_salt() {
+    test::TempDir dir;
+    std::string input = dir / "input";
+    test::write_file(input, test::random_bytes(24 * PoRep::CHUNK_SIZE, 5));
+
+    PlotConfig config = encrypted(dir / "plot");
+    config.checkpoint_interval = 4;
+    plot_killed_after(config, input, 10);
+
+    PoRep resumed(config);
+    resumed.plot(const_cast<char*>(input.c_str()));
+    CHECK(resumed.get_plots() == 24);
+    CHECK(plot_files(config.plot_dir).size() == 24);
+    check_manifest(resumed, config.plot_dir + "/input.manifest");
+}
+
+/// @brief Root of chunk @p chunk of @p input plotted at @p offset under @p salt
+static PoRep::Hash encrypted_root(PoRep& p, const std::string& input, uint64_t chunk, uint64_t offset, uint64_t salt) {
+    PoRep::Workspace ws(p.config, salt);
+    std::ifstream f(input, std::ifstream::binary);
+    f.seekg(chunk * PoRep::CHUNK_SIZE);
+    CHECK(p.read_chunk(f, ws, offset));
+    p.build_chunk(ws, offset);
+    return ws.tree.root();
+}
+
+static void encryption_salt_outlives_the_run() {
+    test::TempDir dir;
+    std::string a = dir / "a", b = dir / "b";
+    write_chunks(a, {0, 1, 2});
+    write_chunks(b, {3, 4});
+
+    // Without checkpoint or manifest, the .salt sidecar is all that records the salt
+    PlotConfig config = encrypted(dir / "plot");
+    config.manifest = false;
+    PoRep p(config);
+    uint64_t salt = p.plot(const_cast<char*>(a.c_str()));
+    CHECK(salt != 0);
+    CHECK(p.load_salt(a) == salt);
+    CHECK(!fs::exists(config.plot_dir + "/a.manifest") && !fs::exists(config.plot_dir + "/a.checkpoint"));
+    auto snapshot = p.search.snapshot();
+    CHECK(snapshot->find(encrypted_root(p, a, 1, 1, salt)) != nullptr);
+    CHECK(snapshot->find(encrypted_root(p, a, 1, 1, salt + 1)) == nullptr);
+
+    // Several inputs share the salt of the call, offsets run on across them
+    uint64_t shared = p.plot(std::vector<std::string>{a, b}, 2);
+    CHECK(shared != 0 && shared != salt);
+    CHECK(p.load_salt(a) == shared && p.load_salt(b) == shared);
+    CHECK(p.search.snapshot()->find(encrypted_root(p, b, 1, 4, shared)) != nullptr);
+
+    // In-memory inputs only get the salt back
+    std::vector<uint8_t> bytes(2 * PoRep::CHUNK_SIZE);
+    std::ifstream(b, std::ifstream::binary).read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+    uint64_t memory = p.plot(bytes.data(), bytes.size());
+    CHECK(memory != 0 && memory != shared);
+    CHECK(p.search.snapshot()->find(encrypted_root(p, b, 0, 0, memory)) != nullptr);
+
+    // Sharded plotting records it in every shard
+    std::vector<std::string> dirs{dir / "s0", dir / "s1"};
+    ShardedPoRepT<PoRep> sharded(config, dirs);
+    uint64_t sharded_salt = sharded.plot(const_cast<char*>(a.c_str()));
+    CHECK(sharded_salt != 0);
+    for (const std::string& d : dirs) {
+        PlotConfig c = config;
+        c.plot_dir = d;
+        CHECK(PoRep(c).load_salt(a) == sharded_salt);
+    }
+
+    // Nothing is recorded without encryption
+    PlotConfig plain;
+    plain.plot_dir = dir / "plain";
+    fs::create_directories(plain.plot_dir);
+    PoRep q(plain);
+    CHECK(q.plot(const_cast<char*>(a.c_str())) == 0);
+    CHECK(!fs::exists(q.salt_path(a)));
+}
+
+/// @brief Chunk offsets stored in the headers of the plot files in @p dir
+static std::multiset<uint64_t> plot_offsets(const std::string& dir) {
+    std::multiset<uint64_t> offsets;
+    for (const auto& f : plot_files(dir)) {
+        size_t begin = 0;
+        offsets.insert(merkle::deserialise_uint64_t(std::vector<uint8_t>(f.second.begin(), f.second.end()), begin));
+    }
+    return offsets;
+}
+
+static void multi_input_offsets() {
+    test::TempDir dir;
+    std::string a = dir / "a", empty = dir / "empty", b = dir / "b", c = dir / "c", whole = dir / "whole";
+    write_chunks(a, {0, 1, 2});
+    test::write_file(empty, {});
+    write_chunks(b, {3});
+    // A trailing partial chunk is not plotted and does not shift the next input
+    std::ofstream(b, std::ofstream::binary | std::ofstream::app) << "partial";
+    write_chunks(c, {4, 5});
+    write_chunks(whole, {0, 1, 2, 3, 4, 5});
+    const std::vector<std::string> inputs{a, empty, b, c};
+
+    // Chunk k of an input is plotted at k plus the chunks of the inputs before it,
+    // as if the inputs were one file
+    for (bool leaves_only : {false, true}) {
+        PlotConfig config;
+        config.leaves_only = leaves_only;
+        config.plot_dir = dir / "reference";
+        fs::remove_all(config.plot_dir);
+        fs::create_directories(config.plot_dir);
+        PoRep reference(config);
+        reference.plot(const_cast<char*>(whole.c_str()));
+        CHECK(plot_offsets(config.plot_dir) == (std::multiset<uint64_t>{0, 1, 2, 3, 4, 5}));
+
+        for (size_t threads : {1, 4}) {
+            config.plot_dir = dir / ("plot" + std::to_string(threads) + (leaves_only ? "l" : ""));
+            fs::create_directories(config.plot_dir);
+            PoRep p(config);
+            CHECK(p.plot(inputs, threads) == 0);
+            CHECK(p.get_plots() == 6 && p.get_conflicts() == 0);
+            CHECK(plot_files(config.plot_dir) == plot_files(dir / "reference"));
+            check_proofs(p, threads);
+        }
+    }
+
+    // The keystream follows the same offsets
+    PlotConfig config = encrypted(dir / "encrypted");
+    config.manifest = false;
+    PoRep p(config);
+    uint64_t salt = p.plot(inputs, 3);
+    auto snapshot = p.search.snapshot();
+    CHECK(snapshot->size() == 6);
+    const std::vector<std::pair<std::string, uint64_t>> firsts{{a, 0}, {b, 3}, {c, 4}};
+    for (const auto& input : firsts) {
+        uint64_t chunks = fs::file_size(input.first) / PoRep::CHUNK_SIZE;
+        for (uint64_t k = 0; k < chunks; k++) {
+            CHECK(snapshot->find(encrypted_root(p, input.first, k, input.second + k, salt)) != nullptr);
+            if (input.second > 0)
+                CHECK(snapshot->find(encrypted_root(p, input.first, k, k, salt)) == nullptr);
+        }
+    }
+    CHECK(plot_offsets(config.plot_dir) == (std::multiset<uint64_t>{0, 1, 2, 3, 4, 5}));
+}
+
+static void sharded_duplicates() {
+    test::TempDir dir;
+    std::string input = dir / "input";
+    std::vector<uint64_t> chunks;
+    for (int copy = 0; copy < 3; copy++) {
+        for (uint64_t i = 0; i < 20; i++)
+            chunks.push_back(i);
+    }
+    write_chunks(input, chunks);
+
+    PlotConfig clean;
+    clean.plot_dir = dir / "clean";
+    fs::create_directories(clean.plot_dir);
+    PoRep reference(clean);
+    reference.plot(const_cast<char*>(input.c_str()));
+
+    // Copies of a chunk land on different shards but are stored once
+    std::vector<std::string> dirs{dir / "a", dir / "b", dir / "c"};
+    ShardedPoRepT<PoRep> sharded(PlotConfig(), dirs);
+    sharded.plot(const_cast<char*>(input.c_str()));
+    CHECK(sharded.get_plots() == reference.get_plots());
+    CHECK(sharded.get_conflicts() == reference.get_conflicts());
+    std::map<std::string, std::string> files;
+    for (const std::string& d : dirs) {
+        for (const auto& f : plot_files(d))
+            CHECK(files.insert(f).second);
+    }
+    CHECK(files == plot_files(clean.plot_dir));
+
+    // A second run conflicts with every stored root
+    sharded.plot(const_cast<char*>(input.c_str()));
+    CHECK(sharded.get_plots() == reference.get_plots());
+    CHECK(sharded.get_conflicts() == reference.get_conflicts() + int(chunks.size()));
+
+    std::vector<uint8_t> bytes = test::random_bytes(64 * sizeof(PoRep::Hash), 6);
+    std::vector<PoRep::Hash> challenges;
+    for (size_t i = 0; i < 64; i++)
+        challenges.push_back(PoRep::Hash(bytes.data() + i * sizeof(PoRep::Hash)));
+    std::vector<PoRep::Proof> proofs = sharded.generate_proofs(challenges);
+    for (size_t i = 0; i < challenges.size(); i++) {
+        CHECK(proofs[i].hashes == reference.generate_proof(challenges[i]).hashes);
+        CHECK(sharded.verify(proofs[i], challenges[i]));
+    }
+}
+
+static void sharded_failed_store() {
+    test::TempDir dir;
+    std::string input = dir / "input";
+    write_chunks(input, {0, 1, 2, 3, 4, 5, 6, 7});
+
+    PlotConfig clean;
+    clean.plot_dir = dir / "clean";
+    fs::create_directories(clean.plot_dir);
+    PoRep reference(clean);
+    reference.plot(const_cast<char*>(input.c_str()));
+    std::map<std::string, std::string> expected = plot_files(clean.plot_dir);
+
+    // A file in the way of one root makes whichever shard stores it fail
+    std::vector<std::string> dirs{dir / "a", dir / "b"};
+    ShardedPoRepT<PoRep> sharded(PlotConfig(), dirs);
+    std::string blocked = std::next(expected.begin(), 3)->first;
+    for (const std::string& d : dirs)
+        test::write_file(d + "/" + blocked, {});
+    bool thrown = false;
+    try {
+        sharded.plot(const_cast<char*>(input.c_str()));
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    // The failed root is not left claimed: once the way is clear it is plotted, the rest conflict
+    for (const std::string& d : dirs)
+        fs::remove(d + "/" + blocked);
+    int plots = sharded.get_plots();
+    CHECK(plots < 8);
+    sharded.plot(const_cast<char*>(input.c_str()));
+    CHECK(sharded.get_plots() == 8);
+    CHECK(sharded.get_conflicts() == plots);
+    PoRep::Hash root(blocked);
+    CHECK(sharded.generate_proof(root).root() == root);
+    std::map<std::string, std::string> files;
+    for (const std::string& d : dirs) {
+        for (const auto& f : plot_files(d))
+            CHECK(files.insert(f).second);
+    }
+    CHECK(files == expected);
+}
+
+int main() {
+    return test::run({
+        {"resume_after_first_chunk", resume_after_first_chunk},
+        {"resume_mid_run", resume_mid_run},
+        {"replot_shared_chunk", replot_shared_chunk},
+        {"segment_dead_records", segment_dead_records},
+        {"replot_packed_chunk", replot_packed_chunk},
+        {"audit_quarantine", audit_quarantine},
+        {"replot_reuses_cache_slots", replot_reuses_cache_slots},
+        {"encryption_salts_every_input", encryption_salts_every_input},
+        {"encryption_resumes_with_its_salt", encryption_resumes_with_its_salt},
+        {"encryption_salt_outlives_the_run", encryption_salt_outlives_the_run},
+        {"multi_input_offsets", multi_input_offsets},
+        {"sharded_duplicates", sharded_duplicates},
+        {"sharded_failed_store", sharded_failed_store},
+    });
+}
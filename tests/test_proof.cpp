@@ -0,0 +1,127 @@
+#include "por.hpp"
+#include "check.hpp"
+
+#include <set>
+
+// Proof scoring: quality() agrees with the sorted-set search it replaced,
+// the batch form scores pair by pair, and best() returns the k lowest
+// scores in order, ties to the earlier proof.
+
+using namespace por;
+
+typedef PoRep::Proof Proof;
+typedef PoRep::Hash Hash;
+
+/// @brief A proof of random hashes
+static Proof random_proof(uint64_t seed) {
+    std::vector<uint8_t> bytes = test::random_bytes(Proof::n * sizeof(Hash), seed);
+    Proof proof;
+    for (size_t i = 0; i < Proof::n; i++)
+        proof.hashes.push_back(Hash(bytes.data() + i * sizeof(Hash)));
+    return proof;
+}
+
+static Hash random_hash(uint64_t seed) {
+    return Hash(test::random_bytes(sizeof(Hash), seed).data());
+}
+
+/// @brief Quality as computed before the linear scan, through a std::set
+static double reference_quality(const Proof& proof, const Hash& challenge) {
+    std::set<Hash> nodes(proof.hashes.begin(), proof.hashes.end() - 1);
+    Hash node = *closest_element(nodes, challenge);
+    Hash h;
+    for (size_t i = 0; i < sizeof(Hash); i++)
+        h.bytes[i] = i < sizeof(Hash) / 2 ? proof.hashes.back().bytes[i] : node.bytes[i];
+    return h.distance(challenge).to_double() / (challenge.to_double() + h.to_double());
+}
+
+static void quality_matches_reference() {
+    for (uint64_t seed = 0; seed < 200; seed++) {
+        Proof proof = random_proof(seed);
+        Hash challenge = random_hash(1000 + seed);
+        CHECK(proof.quality(challenge) == reference_quality(proof, challenge));
+    }
+}
+
+static void closest_node_ties() {
+    Proof proof = random_proof(1);
+    Hash challenge = proof.hashes[3];
+    challenge.bytes[sizeof(Hash) - 1] = 0x80;
+
+    // Equally far below and above: the smaller hash wins, wherever it is
+    Hash below = challenge, above = challenge;
+    below.bytes[sizeof(Hash) - 1] = 0x7F;
+    above.bytes[sizeof(Hash) - 1] = 0x81;
+    proof.hashes[3] = above;
+    proof.hashes[5] = below;
+    CHECK(proof.closest_node(challenge) == below);
+    std::swap(proof.hashes[3], proof.hashes[5]);
+    CHECK(proof.closest_node(challenge) == below);
+
+    // The root is never the closest node, even when it equals the challenge
+    proof.hashes.back() = challenge;
+    CHECK(proof.closest_node(challenge) == below);
+    CHECK(proof.quality(challenge) == reference_quality(proof, challenge));
+
+    // Top half from the root, bottom half from the node: a perfect match scores 0
+    proof.hashes[2] = challenge;
+    CHECK(proof.quality(challenge) == 0);
+}
+
+static void batch_quality() {
+    std::vector<Proof> proofs;
+    std::vector<Hash> challenges;
+    for (uint64_t seed = 0; seed < 50; seed++) {
+        proofs.push_back(random_proof(seed));
+        challenges.push_back(random_hash(1000 + seed));
+    }
+    std::vector<double> scores = Proof::quality(proofs, challenges);
+    CHECK(scores.size() == proofs.size());
+    for (size_t i = 0; i < proofs.size(); i++)
+        CHECK(scores[i] == proofs[i].quality(challenges[i]));
+
+    CHECK(Proof::quality({}, {}).empty());
+    challenges.pop_back();
+    bool thrown = false;
+    try {
+        Proof::quality(proofs, challenges);
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+static void best_proofs() {
+    std::vector<Proof> proofs;
+    for (uint64_t seed = 0; seed < 40; seed++)
+        proofs.push_back(random_proof(seed));
+    // Copies score the same as their original and rank right after it
+    proofs.push_back(proofs[7]);
+    proofs.push_back(proofs[7]);
+    proofs.insert(proofs.begin(), proofs[20]);
+    Hash challenge = random_hash(99);
+
+    std::vector<size_t> sorted(proofs.size());
+    for (size_t i = 0; i < sorted.size(); i++)
+        sorted[i] = i;
+    std::stable_sort(sorted.begin(), sorted.end(), [&](size_t a, size_t b) {
+        return proofs[a].quality(challenge) < proofs[b].quality(challenge);
+    });
+
+    for (size_t k : {size_t(0), size_t(1), size_t(5), proofs.size(), proofs.size() + 10}) {
+        std::vector<size_t> picked = Proof::best(proofs, challenge, k);
+        CHECK(picked.size() == std::min(k, proofs.size()));
+        CHECK(std::equal(picked.begin(), picked.end(), sorted.begin()));
+    }
+    CHECK(Proof::best({}, challenge, 3).empty());
+}
+
+int main() {
+    return test::run({
+        {"quality_matches_reference", quality_matches_reference},
+        {"closest_node_ties", closest_node_ties},
+        {"batch_quality", batch_quality},
+        {"best_proofs", best_proofs},
+    });
+}
@@ -0,0 +1,254 @@
+#include "prover.hpp"
+#include "check.hpp"
+
+// The prover daemon protocol: single and batched challenges come back as
+// the proofs the prover generates in process, errors come back as messages
+// without dropping the connection, and malformed requests are refused.
+// Rescans follow plots added, deleted and compacted by another process.
+
+using namespace por;
+
+typedef PoRep::Hash Hash;
+typedef ProverServerT<PoRep> Server;
+typedef ProverClientT<PoRep> Client;
+
+static std::vector<Hash> challenges(size_t count, uint64_t seed) {
+    std::vector<uint8_t> bytes = test::random_bytes(count * sizeof(Hash), seed);
+    std::vector<Hash> result;
+    for (size_t i = 0; i < count; i++)
+        result.push_back(Hash(bytes.data() + i * sizeof(Hash)));
+    return result;
+}
+
+/// @brief Plots @p chunks random chunks into @p dir
+static void plot_store(PoRep& p, const test::TempDir& dir, size_t chunks) {
+    std::string input = dir / "input";
+    test::write_file(input, test::random_bytes(chunks * PoRep::CHUNK_SIZE, 1));
+    p.plot(const_cast<char*>(input.c_str()));
+}
+
+/// @brief Sends raw bytes on a fresh connection and reads the response header
+static uint8_t raw_request(const std::string& socket_path, const std::vector<uint8_t>& request, std::string& message) {
+    sockaddr_un addr = protocol::address(socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    CHECK(fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+    CHECK(protocol::write_full(fd, request.data(), request.size()));
+    uint8_t header[protocol::HEADER];
+    CHECK(protocol::read_full(fd, header, sizeof(header)));
+    message.assign(protocol::load_count(header), '\0');
+    CHECK(protocol::read_full(fd, &message[0], message.size()));
+    // Refused requests close the connection
+    uint8_t byte;
+    CHECK(!protocol::read_full(fd, &byte, 1));
+    close(fd);
+    return header[0];
+}
+
+static void header_round_trip() {
+    uint8_t header[protocol::HEADER];
+    for (uint32_t count : {0u, 1u, 0x01020304u, protocol::MAX_BATCH, 0xFFFFFFFFu}) {
+        protocol::store_header(protocol::PROVE_BATCH, count, header);
+        CHECK(header[0] == protocol::PROVE_BATCH);
+        CHECK(protocol::load_count(header) == count);
+    }
+    protocol::store_header(protocol::OK, 0x01020304, header);
+    CHECK(header[1] == 1 && header[2] == 2 && header[3] == 3 && header[4] == 4);
+}
+
+static void prove_round_trip() {
+    test::TempDir dir;
+    PlotConfig config;
+    config.plot_dir = dir / "plot";
+    fs::create_directories(config.plot_dir);
+    PoRep p(config);
+    plot_store(p, dir, 8);
+
+    std::string socket_path = dir / "por.sock";
+    {
+        Server server(p, socket_path);
+        Client client(socket_path);
+        std::vector<Hash> batch = challenges(100, 2);
+        for (size_t i = 0; i < 10; i++) {
+            PoRep::Proof proof = client.prove(batch[i]);
+            CHECK(proof.hashes == p.generate_proof(batch[i]).hashes);
+            CHECK(p.verify(proof, batch[i]));
+        }
+
+        std::vector<PoRep::Proof> proofs = client.prove(batch);
+        CHECK(proofs.size() == batch.size());
+        for (size_t i = 0; i < batch.size(); i++)
+            CHECK(proofs[i].hashes == p.generate_proof(batch[i]).hashes);
+        CHECK(client.prove(std::vector<Hash>()).empty());
+
+        // Clients are served side by side
+        std::vector<std::thread> threads;
+        std::atomic<size_t> proven(0);
+        for (uint64_t t = 0; t < 4; t++) {
+            threads.emplace_back([&, t]() {
+                Client other(socket_path);
+                std::vector<Hash> mine = challenges(50, 10 + t);
+                std::vector<PoRep::Proof> answers = other.prove(mine);
+                for (size_t i = 0; i < mine.size(); i++)
+                    proven += p.verify(answers[i], mine[i]);
+            });
+        }
+        for (auto& t : threads)
+            t.join();
+        CHECK(proven == 200);
+        CHECK(server.served() == 10 + 100 + 200);
+    }
+    // The socket goes away with the server
+    CHECK(!fs::exists(socket_path));
+}
+
+static void errors_and_bad_requests() {
+    test::TempDir dir;
+    PlotConfig config;
+    config.plot_dir = dir / "plot";
+    fs::create_directories(config.plot_dir);
+    PoRep p(config);
+
+    std::string socket_path = dir / "por.sock";
+    Server server(p, socket_path);
+    {
+        // An empty store cannot prove, but the connection stays usable
+        Client client(socket_path);
+        for (size_t i = 0; i < 2; i++) {
+            bool thrown = false;
+            try {
+                client.prove(challenges(1, 3)[0]);
+            }
+            catch (const std::runtime_error& e) {
+                thrown = std::string(e.what()) == "Prover error: No plots to prove from";
+            }
+            CHECK(thrown);
+        }
+        bool thrown = false;
+        try {
+            client.prove(std::vector<Hash>(protocol::MAX_BATCH + 1));
+        }
+        catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+
+    std::string message;
+    std::vector<uint8_t> request(protocol::HEADER);
+    protocol::store_header(7, 1, request.data());
+    CHECK(raw_request(socket_path, request, message) == protocol::ERROR && message == "Invalid request");
+    // A single challenge request carries exactly one challenge
+    protocol::store_header(protocol::PROVE, 2, request.data());
+    CHECK(raw_request(socket_path, request, message) == protocol::ERROR && message == "Invalid request");
+    protocol::store_header(protocol::PROVE_BATCH, protocol::MAX_BATCH + 1, request.data());
+    CHECK(raw_request(socket_path, request, message) == protocol::ERROR && message == "Invalid request");
+    CHECK(server.served() == 0);
+
+    // Plots indexed later are served without restarting
+    plot_store(p, dir, 4);
+    Client client(socket_path);
+    Hash challenge = challenges(1, 4)[0];
+    CHECK(p.verify(client.prove(challenge), challenge));
+    CHECK(server.served() == 1);
+}
+
+/// @brief Plots @p chunks chunks of seed @p seed into @p dir with a plotter of its own
+static void plot_more(const PlotConfig& config, const test::TempDir& dir, size_t chunks, uint64_t seed) {
+    std::string input = dir / ("input" + std::to_string(seed));
+    test::write_file(input, test::random_bytes(chunks * PoRep::CHUNK_SIZE, seed));
+    PoRep(config).plot(const_cast<char*>(input.c_str()));
+}
+
+/// @brief Roots of the plot files in @p dir
+static std::vector<Hash> plot_roots(const std::string& dir) {
+    std::vector<Hash> roots;
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        std::string name = entry.path().filename();
+        if (name.size() == 2 * sizeof(Hash))
+            roots.push_back(Hash(name));
+    }
+    std::sort(roots.begin(), roots.end());
+    return roots;
+}
+
+static bool same(const RescanReport& r, size_t added, size_t moved, size_t dropped) {
+    return r.added == added && r.moved == moved && r.dropped == dropped;
+}
+
+/// @brief Proves every root in @p roots through @p client, each being its own closest root
+static void check_served(Client& client, PoRep& p, const std::vector<Hash>& roots) {
+    for (const Hash& root : roots) {
+        PoRep::Proof proof = client.prove(root);
+        CHECK(proof.root() == root && p.verify(proof, root));
+    }
+}
+
+static void rescan_follows_the_store() {
+    test::TempDir dir;
+    PlotConfig config;
+    config.plot_dir = dir / "plot";
+    config.cache_levels = 3;
+    config.cache_budget = 1 << 20;
+    fs::create_directories(config.plot_dir);
+    plot_more(config, dir, 4, 1);
+
+    PoRep p(config);
+    p.load_plot(config.plot_dir);
+    std::string socket_path = dir / "por.sock";
+    Server server(p, socket_path);
+    Client client(socket_path);
+    CHECK(same(server.rescan(), 0, 0, 0));
+
+    // New plots are added, deleted ones dropped
+    plot_more(config, dir, 3, 2);
+    CHECK(same(server.rescan(), 3, 0, 0));
+    std::vector<Hash> roots = plot_roots(config.plot_dir);
+    CHECK(p.search.size() == 7);
+    check_served(client, p, roots);
+    fs::remove(config.plot_dir + "/" + roots[2].to_string());
+    CHECK(same(server.rescan(), 0, 0, 1));
+    CHECK(p.search.snapshot()->find(roots[2]) == nullptr);
+    roots.erase(roots.begin() + 2);
+    check_served(client, p, roots);
+
+    // Another process compacts: while both copies exist nothing changes, then the roots move
+    std::string backup = dir / "backup";
+    fs::create_directories(backup);
+    for (const Hash& root : roots)
+        fs::copy_file(config.plot_dir + "/" + root.to_string(), backup + "/" + root.to_string());
+    PoRep compactor(config);
+    compactor.load_plot(config.plot_dir);
+    CHECK(compactor.compact().segments == 1);
+    for (const Hash& root : roots)
+        fs::copy_file(backup + "/" + root.to_string(), config.plot_dir + "/" + root.to_string());
+    CHECK(same(server.rescan(), 0, 0, 0));
+    for (const Hash& root : roots)
+        fs::remove(config.plot_dir + "/" + root.to_string());
+    CHECK(same(server.rescan(), 0, 6, 0));
+    CHECK(p.search.size() == 6);
+    for (const Hash& root : roots)
+        CHECK(p.search.snapshot()->find(root)->value.segment != PoRep::NO_SEGMENT);
+    check_served(client, p, roots);
+
+    // A record marked dead is dropped, and so is a deleted segment
+    auto entry = *p.search.snapshot()->find(roots[0]);
+    compactor.mark_dead(entry.value.segment, {entry.value.record});
+    CHECK(same(server.rescan(), 0, 0, 1));
+    CHECK(p.search.size() == 5);
+    plot_more(config, dir, 2, 3);
+    fs::remove(p.segment_path(entry.value.segment));
+    fs::remove(p.segment_path(entry.value.segment) + ".roots");
+    CHECK(same(server.rescan(), 2, 0, 5));
+    roots = plot_roots(config.plot_dir);
+    CHECK(p.search.size() == 2 && roots.size() == 2);
+    check_served(client, p, roots);
+}
+
+int main() {
+    return test::run({
+        {"header_round_trip", header_round_trip},
+        {"prove_round_trip", prove_round_trip},
+        {"errors_and_bad_requests", errors_and_bad_requests},
+        {"rescan_follows_the_store", rescan_follows_the_store},
+    });
+}
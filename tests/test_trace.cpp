@@ -0,0 +1,93 @@
+#include "trace.hpp"
+#include "check.hpp"
+
+#include <map>
+#include <thread>
+
+// The tracer: buffers of exited threads are reused, and dumps taken while
+// threads record only contain whole events.
+
+using namespace por;
+
+/// @brief Per thread id of a dump, the start times of its events in file order
+static std::map<uint32_t, std::vector<double>> read_dump(const std::string& path, size_t& names) {
+    std::map<uint32_t, std::vector<double>> threads;
+    names = 0;
+    std::ifstream f(path);
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line.find("\"thread_name\"") != std::string::npos) {
+            names++;
+            continue;
+        }
+        size_t at = line.find("\"ts\":");
+        if (at == std::string::npos)
+            continue;
+        CHECK(line.find("\"name\":\"test.event\"") != std::string::npos);
+        double ts, dur;
+        unsigned tid;
+        CHECK(sscanf(line.c_str() + at, "\"ts\":%lf,\"dur\":%lf,\"pid\":%*d,\"tid\":%u", &ts, &dur, &tid) == 3);
+        CHECK(dur == 1.0);
+        threads[tid].push_back(ts);
+    }
+    return threads;
+}
+
+/// @brief Records @p count one-microsecond events starting at @p first microseconds
+static void record(uint64_t first, uint64_t count) {
+    auto origin = std::chrono::steady_clock::now();
+    for (uint64_t i = first; i < first + count; i++) {
+        auto begin = origin + std::chrono::microseconds(i);
+        Tracer::instance().record("test.event", begin, begin + std::chrono::microseconds(1));
+    }
+}
+
+static void exited_threads_recycled() {
+    test::TempDir dir;
+    Tracer::instance().start(64);
+    for (int t = 0; t < 50; t++)
+        std::thread(record, 0, 10).join();
+    Tracer::instance().stop();
+    Tracer::instance().dump(dir / "trace.json");
+
+    // One buffer served every thread and holds the events of the last one
+    size_t names = 0;
+    auto threads = read_dump(dir / "trace.json", names);
+    CHECK(names == 1);
+    CHECK(threads.size() == 1);
+    CHECK(threads.begin()->second.size() == 10);
+}
+
+static void dump_while_recording() {
+    test::TempDir dir;
+    Tracer::instance().start(64);
+    std::atomic<bool> done(false);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; t++) {
+        writers.emplace_back([&]() {
+            for (uint64_t first = 0; !done; first += 16)
+                record(first, 16);
+        });
+    }
+    // Events of a thread start later and later, so a torn one would stand out
+    for (int i = 0; i < 200; i++) {
+        Tracer::instance().dump(dir / "trace.json");
+        size_t names = 0;
+        for (const auto& t : read_dump(dir / "trace.json", names)) {
+            CHECK(t.second.size() <= 64);
+            for (size_t j = 1; j < t.second.size(); j++)
+                CHECK(t.second[j] > t.second[j - 1]);
+        }
+    }
+    done = true;
+    for (auto& w : writers)
+        w.join();
+    Tracer::instance().stop();
+}
+
+int main() {
+    return test::run({
+        {"exited_threads_recycled", exited_threads_recycled},
+        {"dump_while_recording", dump_while_recording},
+    });
+}
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace por {
+
+    /// @brief Collects timed events of every thread and exports them as a
+    /// Chrome trace (chrome://tracing, ui.perfetto.dev)
+    ///
+    /// Off by default, when a TraceScope costs one relaxed atomic load.
+    /// Once started, every thread records into its own ring buffer, which
+    /// keeps the latest events only, so long runs stay bounded in memory.
+    /// Recording takes no lock: the owning thread is the only writer of its
+    /// ring, and dump() discards the entries it may have overwritten during
+    /// the read. The buffer of an exited thread stays dumpable until a new
+    /// thread takes it over, so memory follows the peak number of threads.
+    class Tracer {
+        public:
+            /// @brief A completed span
+            struct Event {
+                /// @brief Static string naming the span
+                const char* name;
+                /// @brief Start, in nanoseconds since start()
+                uint64_t begin;
+                uint64_t duration;
+            };
+
+            static Tracer& instance() {
+                static Tracer tracer;
+                return tracer;
+            }
+
+            /// @brief Drops the events so far and starts recording
+            /// @param capacity Events kept per thread
+            void start(size_t capacity = 1 << 16) {
+                std::lock_guard<std::mutex> lock(m);
+                this->capacity = capacity;
+                // Owned buffers are reset by their thread on its next event
+                uint64_t g = generation.load(std::memory_order_relaxed) + 1;
+                generation.store(g, std::memory_order_release);
+                for (auto& b : buffers) {
+                    if (!b->owned)
+                        b->reset(capacity, g);
+                }
+                origin.store(nanoseconds(std::chrono::steady_clock::now()), std::memory_order_relaxed);
+                on.store(true, std::memory_order_release);
+            }
+
+            /// @brief Stops recording, keeping the events for dump()
+            void stop() {
+                on.store(false, std::memory_order_release);
+            }
+
+            bool enabled() const {
+                return on.load(std::memory_order_relaxed);
+            }
+
+            /// @brief Records a span of the calling thread
+            void record(const char* name, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end) {
+                int64_t start = nanoseconds(begin) - origin.load(std::memory_order_relaxed);
+                local().add(Event{name, uint64_t(std::max<int64_t>(start, 0)), uint64_t(nanoseconds(end) - nanoseconds(begin))});
+            }
+
+            /// @brief Writes the recorded events as Chrome trace JSON
+            void dump(const std::string& path) {
+                std::ofstream f(path);
+                if (!f.good())
+                    throw std::runtime_error("Cannot write trace " + path);
+                f << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+                bool first = true;
+                std::lock_guard<std::mutex> lock(m);
+                for (auto& b : buffers) {
+                    // Not reset since start() yet, so it only holds older events
+                    if (b->generation != generation.load(std::memory_order_relaxed))
+                        continue;
+                    uint64_t dropped = 0;
+                    std::vector<Event> events = b->events(dropped);
+                    f << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << getpid()
+                      << ",\"tid\":" << b->tid << ",\"args\":{\"name\":\"thread " << b->tid
+                      << (dropped > 0 ? " (" + std::to_string(dropped) + " older events dropped)" : "") << "\"}}";
+                    first = false;
+                    char ts[64];
+                    for (const Event& e : events) {
+                        snprintf(ts, sizeof(ts), "\"ts\":%.3f,\"dur\":%.3f", e.begin / 1e3, e.duration / 1e3);
+                        f << ",\n{\"name\":\"" << e.name << "\",\"cat\":\"por\",\"ph\":\"X\"," << ts
+                          << ",\"pid\":" << getpid() << ",\"tid\":" << b->tid << "}";
+                    }
+                }
+                f << "\n]}\n";
+            }
+
+        private:
+            /// @brief Ring buffer written by one thread at a time
+            ///
+            /// Slots are atomics so dump() can read them while the owner
+            /// writes; reset() and the hand-over to a new thread happen
+            /// under the tracer's mutex, so never during a dump().
+            struct Buffer {
+                struct Slot {
+                    std::atomic<const char*> name{nullptr};
+                    std::atomic<uint64_t> begin{0};
+                    std::atomic<uint64_t> duration{0};
+                };
+
+                void reset(size_t capacity, uint64_t generation) {
+                    size = std::max<size_t>(capacity, 1);
+                    ring.reset(new Slot[size]);
+                    head.store(0, std::memory_order_relaxed);
+                    this->generation = generation;
+                }
+
+                /// @brief Appends an event (owner only)
+                void add(const Event& e) {
+                    uint64_t h = head.load(std::memory_order_relaxed);
+                    // A dump() that reads any of the stores below also sees head >= h
+                    std::atomic_thread_fence(std::memory_order_release);
+                    Slot& slot = ring[h % size];
+                    slot.name.store(e.name, std::memory_order_relaxed);
+                    slot.begin.store(e.begin, std::memory_order_relaxed);
+                    slot.duration.store(e.duration, std::memory_order_relaxed);
+                    head.store(h + 1, std::memory_order_release);
+                }
+
+                /// @brief Events oldest first, without the slots the owner may have
+                /// rewritten meanwhile
+                std::vector<Event> events(uint64_t& dropped) const {
+                    uint64_t end = head.load(std::memory_order_acquire);
+                    uint64_t first = end - std::min<uint64_t>(end, size);
+                    std::vector<Event> all;
+                    all.reserve(end - first);
+                    for (uint64_t i = first; i < end; i++) {
+                        const Slot& slot = ring[i % size];
+                        all.push_back(Event{slot.name.load(std::memory_order_relaxed),
+                                            slot.begin.load(std::memory_order_relaxed),
+                                            slot.duration.load(std::memory_order_relaxed)});
+                    }
+                    // Slot of event i is rewritten from the moment the owner
+                    // starts event i + size, which may be the unpublished one
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    uint64_t now = head.load(std::memory_order_relaxed);
+                    uint64_t valid = now + 1 > size ? now + 1 - size : 0;
+                    size_t torn = std::min<uint64_t>(all.size(), valid > first ? valid - first : 0);
+                    all.erase(all.begin(), all.begin() + torn);
+                    dropped = end - all.size();
+                    return all;
+                }
+
+                uint32_t tid = 0;
+                /// @brief Whether a live thread writes to the buffer
+                bool owned = false;
+                /// @brief Tracer generation the buffer was last reset for
+                uint64_t generation = 0;
+                std::unique_ptr<Slot[]> ring;
+                size_t size = 0;
+                /// @brief Events ever added since the last reset
+                std::atomic<uint64_t> head{0};
+            };
+
+            /// @brief Hands the buffer of a thread back to the tracer when the thread exits
+            struct Owner {
+                Buffer* buffer = nullptr;
+
+                ~Owner() {
+                    if (buffer != nullptr)
+                        Tracer::instance().release(*buffer);
+                }
+            };
+
+            Tracer() = default;
+
+            static int64_t nanoseconds(std::chrono::steady_clock::time_point t) {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+            }
+
+            /// @brief Buffer of the calling thread, taken on first use from the
+            /// buffers of exited threads or newly registered
+            Buffer& local() {
+                thread_local Owner owner;
+                Buffer* b = owner.buffer;
+                if (b != nullptr && b->generation == generation.load(std::memory_order_acquire))
+                    return *b;
+
+                std::lock_guard<std::mutex> lock(m);
+                if (b == nullptr) {
+                    if (released.empty()) {
+                        buffers.emplace_back(new Buffer());
+                        b = buffers.back().get();
+                    }
+                    else {
+                        b = released.back();
+                        released.pop_back();
+                    }
+                    b->owned = true;
+                    b->tid = ++threads;
+                    b->generation = ~generation.load(std::memory_order_relaxed);
+                    owner.buffer = b;
+                }
+                if (b->generation != generation.load(std::memory_order_relaxed))
+                    b->reset(capacity, generation.load(std::memory_order_relaxed));
+                return *b;
+            }
+
+            /// @brief Keeps the events of an exited thread until another thread takes its buffer
+            void release(Buffer& b) {
+                std::lock_guard<std::mutex> lock(m);
+                b.owned = false;
+                released.push_back(&b);
+            }
+
+            std::atomic<bool> on{false};
+            std::mutex m;
+            std::vector<std::unique_ptr<Buffer>> buffers;
+            /// @brief Buffers of exited threads, reused before new ones
+            std::vector<Buffer*> released;
+            /// @brief Threads that took a buffer so far, numbering them
+            uint32_t threads = 0;
+            /// @brief Bumped by start(), buffers of older generations are reset before use
+            std::atomic<uint64_t> generation{0};
+            size_t capacity = 1 << 16;
+            /// @brief Time of start(), in steady clock nanoseconds
+            std::atomic<int64_t> origin{0};
+    };
+
+    /// @brief Records the lifetime of the scope as a span while tracing is on
+    class TraceScope {
+        public:
+            /// @param name Static string naming the span
+            explicit TraceScope(const char* name) :
+                name(Tracer::instance().enabled() ? name : nullptr)
+            {
+                if (this->name != nullptr)
+                    begin = std::chrono::steady_clock::now();
+            }
+
+            TraceScope(const TraceScope&) = delete;
+            TraceScope& operator=(const TraceScope&) = delete;
+
+            ~TraceScope() {
+                if (name != nullptr)
+                    Tracer::instance().record(name, begin, std::chrono::steady_clock::now());
+            }
+
+        private:
+            const char* name;
+            std::chrono::steady_clock::time_point begin;
+    };
+
+    /// @brief Locks @p m, recording the wait as span @p name
+    inline std::unique_lock<std::mutex> traced_lock(std::mutex& m, const char* name) {
+        TraceScope scope(name);
+        return std::unique_lock<std::mutex>(m);
+    }
+}